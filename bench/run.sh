@@ -0,0 +1,72 @@
+#!/bin/bash
+# times every bench/*.lspy under the tree-walker and under --vm. each time is the best user+sys
+# over $RUNS runs. a second binary (built from an older commit, or with -DLISPY_NO_SLAB, say) is
+# timed the same way in the columns after
+#
+#   bench/run.sh [path/to/lispy] [path/to/other/lispy]
+#   RUNS=5 ONLY=fib bench/run.sh ./lispy
+#
+# the benchmarks that need big source files are written out by gen below first. for those, the
+# matching -quoted file reads the same text without evaluating it, so the difference between the
+# two is the evaluation alone
+
+lispy=${1:-./lispy}
+other=$2
+runs=${RUNS:-3}
+dir=$(dirname "$0")
+
+if [ ! -x "$lispy" ]; then
+    echo "no lispy binary at $lispy"
+    exit 2
+fi
+
+TIMEFORMAT='%3U %3S'
+
+gen=$(mktemp -d)
+trap 'rm -rf "$gen"' EXIT
+
+# env-N: N globals, then one (+ ...) with 20000 references to them
+for n in 10 1000 10000; do
+    awk -v n=$n 'BEGIN { for (i = 0; i < n; i++) printf "(def {v%d} %d)\n", i, i }' > "$gen/defs"
+    refs=$(awk -v n=$n 'BEGIN { for (i = 0; i < 20000; i++) printf " v%d", i % n }')
+    { cat "$gen/defs"; echo "(print (+$refs))"; } > "$gen/env-$n.lspy"
+    { cat "$gen/defs"; echo "(def {r} {+$refs})"; } > "$gen/env-$n-quoted.lspy"
+done
+rm "$gen/defs"
+
+# args-N: one join, one + and one list, each with N arguments
+for n in 20000 80000; do
+    awk -v n=$n 'BEGIN {
+        for (i = 0; i < n; i++) { j = j " {" i "}"; a = a " " i }
+        printf "(def {j} (join%s))\n(def {s} (+%s))\n(def {l} (list%s))\n", j, a, a
+    }' > "$gen/args-$n.lspy"
+    sed 's/^(def {\(.\)} (\(.*\)))$/(def {\1} {\2})/' "$gen/args-$n.lspy" > "$gen/args-$n-quoted.lspy"
+done
+
+# best time for one binary and mode on one file, or - if it didn't run to the end or (for
+# binaries from before the VM) doesn't know the mode
+best() {
+    local bin=$1 mode=$2 file=$3 t min=
+    if [ -n "$mode" ] && [ -n "$("$bin" $mode /dev/null 2>&1)" ]; then echo "-"; return; fi
+    for i in $(seq "$runs"); do
+        t=$( { time "$bin" $mode "$file" >/dev/null 2>&1 || echo x; } 2>&1 )
+        case $t in *x*) echo "-"; return ;; esac
+        t=$(echo "$t" | awk '{ printf "%.3f", $1 + $2 }')
+        min=$(echo "$min $t" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')
+    done
+    echo "$min"
+}
+
+header="%-22s %8s %8s"
+[ -n "$other" ] && header="$header %8s %8s"
+printf "$header\n" bench tree vm ${other:+"tree'" "vm'"}
+
+for f in "$dir"/*.lspy "$gen"/*.lspy; do
+    name=$(basename "$f" .lspy)
+    case $name in *${ONLY}*) ;; *) continue ;; esac
+    row=$(printf "%-22s %8s %8s" "$name" "$(best "$lispy" "" "$f")" "$(best "$lispy" --vm "$f")")
+    if [ -n "$other" ]; then
+        row=$(printf "%s %8s %8s" "$row" "$(best "$other" "" "$f")" "$(best "$other" --vm "$f")")
+    fi
+    echo "$row"
+done
@@ -1,4 +1,8 @@
 #include "mpc.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <string.h>
@@ -38,52 +42,1093 @@ struct lval;
 struct lenv;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lchunk lchunk;
+typedef struct lbig lbig;
+typedef struct lmap lmap;
+
+// strings shorter than this are stored inside the lval itself
+#define LVAL_SSO 20
 
 // possible lval types
-enum { LVAL_ERR, LVAL_NUM, LVAL_SYM, LVAL_STR,
-       LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR };
+enum { LVAL_ERR, LVAL_NUM, LVAL_DBL, LVAL_SYM, LVAL_STR,
+       LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR, LVAL_VEC, LVAL_MAP, LVAL_BUILDER };
+
+// what lval_free leaves in the type of a freed lval, so walking the slab can skip it
+#define LVAL_FREE -1
+
+// what a vector's elements are stored as
+enum { LVEC_INT, LVEC_DBL, LVEC_ANY };
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
 // def "lisp value" -- 
+// lvals are reference counted and shared rather than deep copied: lval_copy hands out another
+// reference, and anything that wants to change a value in place calls lval_own first, which
+// gives it a private (shallow) copy if someone else still holds a reference
+// only the fields for the lval's type are used, so they share storage
 struct lval {
-    int type;
-    long num;
+    short type;
+    short gen;      // LGC_YOUNG_GEN or LGC_OLD_GEN, and flags, see the garbage collector
+    int refs;
+
+    union {
+        // numbers are a plain long unless they don't fit in one, then big holds the value
+        struct {
+            long num;
+            lbig* big;
+        };
+
+        double dbl;
+
+        char* err;
+
+        // strings carry their length (and stay NUL terminated too). short ones are kept in
+        // sbuf, with str pointing at it, so they don't need a malloc of their own
+        struct {
+            char* str;
+            int slen;
+            char sbuf[LVAL_SSO];
+        };
+
+        // slot is where builtin_lambda expects to find sym in the frame it is evaluated in, or -1
+        struct {
+            char* sym;
+            int slot;
+        };
+
+        // functions: builtins only use builtin, lambdas have builtin == NULL
+        struct {
+            lbuiltin builtin;   
+            lenv* env;
+            lval* formals;
+            lval* body;
+        };
+
+        // S-Expressions and Q-Expressions. cell points at the first element of an array with
+        // room for cap pointers, off of which sit before cell (left behind by popping the front).
+        // code caches the list's compiled bytecode when running on the VM
+        struct {
+            int count;
+            int cap;
+            int off;
+            lval** cell;
+            lchunk* code;
+        };
+
+        // vectors: vlen elements stored as vkind says, unboxed longs or doubles or else lvals
+        struct {
+            int vlen;
+            int vkind;
+            union {
+                long* vints;
+                double* vdbls;
+                lval** vcells;
+            };
+        };
+
+        lmap* map;
+
+        // string builders: blen chars of text in a buffer with room for bcap
+        struct {
+            char* bbuf;
+            int blen;
+            int bcap;
+        };
+    };
+};
+  
+
+/* Allocation */
+// lvals and lenvs are allocated and freed constantly (every evaluation makes a pile of
+// temporaries), so they come from per-size slabs: big malloc'd chunks carved up with a bump
+// pointer, with freed objects kept on a free list for reuse. build with -DLISPY_NO_SLAB to
+// go straight to malloc/free instead. the counters are kept either way, and so are ways of
+// finding every object (lslab_each, or a few at a time with lslab_walk), which the garbage
+// collector needs
+
+#define LSLAB_CHUNK 65536
+
+// everything else lvals and lenvs own (strings, cells, vectors, maps, bignums, bindings and
+// compiled code) goes through lmem_alloc and friends, and is given back to lmem_free with the
+// size it was allocated with (which every owner can work out from its own fields, so there is
+// no header on each block). so lmem_live is exactly the bytes asked for by everything that is
+// alive, lval and lenv objects included, though not malloc's own overhead or the fixed frame
+// stack. going over lmem_limit sets lmem_over, which the evaluators look at (see lmem_exceeded)
+
+long lmem_live = 0;
+long lmem_peak = 0;
+long lmem_limit = LONG_MAX;
+int lmem_over = 0;
+// the lower of the peak and the limit, so that allocating only has the one thing to look at
+long lmem_mark = 0;
+
+void lmem_rise(void) {
+    if (lmem_live > lmem_peak) { lmem_peak = lmem_live; }
+    if (lmem_live > lmem_limit) { lmem_over = 1; }
+    lmem_mark = lmem_peak < lmem_limit ? lmem_peak : lmem_limit;
+}
+
+void lmem_add(long n) {
+    lmem_live += n;
+    if (lmem_live > lmem_mark) { lmem_rise(); }
+}
+
+// top-level evaluations running (see lval_eval_top), more than one when they load files
+int lmem_depth = 0;
+
+// most of what a top-level evaluation allocates is temporaries, gone by the time it is done,
+// so while one runs the cells of lists and the text of strings come from an arena instead:
+// allocating is bumping a pointer and freeing does nothing at all. once it is done,
+// larena_reset gives whatever is still alive a malloc'd copy and empties the arena in one go.
+// everything that got a block is in larena_owners, which is where it looks. an evaluation
+// that fills the arena just goes back to malloc.
+// owners can be freed before then. a slab keeps the memory and the freed object's type says
+// LVAL_FREE (or it is some other lval by now), so the list can just keep pointing at it. with
+// -DLISPY_NO_SLAB it would point at memory that has gone back to malloc, so there an owner is
+// marked with LARENA_OWNER (a flag in gen, next to the collector's) and lval_free leaves it
+// for larena_reset
+#define LARENA_OWNER 16
+
+#ifndef LARENA_SIZE
+#define LARENA_SIZE (256 * 1024)
+#endif
+
+char* larena = NULL;
+size_t larena_used = 0;
+lval** larena_owners = NULL;
+long larena_count = 0;
+
+int larena_has(void* p) {
+    return (char*)p >= larena && (char*)p < larena + LARENA_SIZE;
+}
+
+void* lmem_alloc(size_t n) {
+    lmem_add(n);
+    return malloc(n);
+}
+
+// n bytes for owner's cells or text, from the arena if there is one going and it has room
+void* lmem_alloc_in(lval* owner, size_t n) {
+    // every block is at least a word and stays word aligned, so there can't be more owners
+    // than words in the arena
+    size_t size = n ? (n + 7) & ~(size_t)7 : 8;
+    if (!lmem_depth || size > LARENA_SIZE - larena_used) { return lmem_alloc(n); }
+
+    lmem_add(n);
+#ifdef LISPY_NO_SLAB
+    if (!(owner->gen & LARENA_OWNER)) {
+        owner->gen |= LARENA_OWNER;
+        larena_owners[larena_count++] = owner;
+    }
+#else
+    larena_owners[larena_count++] = owner;
+#endif
+    char* p = larena + larena_used;
+    larena_used += size;
+    return p;
+}
+
+// NULL if there isn't the memory, in which case nothing is counted
+void* lmem_calloc(size_t n, size_t size) {
+    void* p = calloc(n, size);
+    if (p) { lmem_add(n * size); }
+    return p;
+}
+
+// p was old bytes (or NULL and 0). it mustn't be in the arena
+void* lmem_realloc(void* p, size_t old, size_t n) {
+    lmem_live -= old;
+    lmem_add(n);
+    return realloc(p, n);
+}
+
+// the allocations above always go ahead, and an evaluation that goes over its quota is stopped
+// at the next safe point. that is fine for the fixed size things an evaluation makes by the
+// thousand, but the program picks how big a vector or builder is, and could ask for more than
+// the quota (or the machine) has in one go. those use these instead, which give NULL and count
+// nothing if the n bytes would take lmem_live over lmem_limit, or if malloc can't find them.
+// lmem_refusing says which it was (see lmem_refused)
+int lmem_refusing = 0;
+
+int lmem_room(size_t n) {
+    lmem_refusing = (lmem_live > lmem_limit || n > (size_t)(lmem_limit - lmem_live));
+    return !lmem_refusing;
+}
+
+void* lmem_try_calloc(size_t n, size_t size) {
+    if (size && n > SIZE_MAX / size) {
+        lmem_refusing = 0;
+        return NULL;
+    }
+    if (!lmem_room(n * size)) { return NULL; }
+    return lmem_calloc(n, size);
+}
+
+// like lmem_realloc, but p is left as it was when this gives NULL
+void* lmem_try_realloc(void* p, size_t old, size_t n) {
+    if (n > old && !lmem_room(n - old)) { return NULL; }
+    void* q = realloc(p, n);
+    if (!q) {
+        lmem_refusing = 0;
+        return NULL;
+    }
+    lmem_live -= old;
+    lmem_add(n);
+    return q;
+}
+
+void lmem_free(void* p, size_t n) {
+    if (!p) { return; }
+    lmem_live -= n;
+    if (!larena_has(p)) { free(p); }
+}
+
+void* lmem_promote(void* p, size_t n) {
+    void* q = malloc(n);
+    memcpy(q, p, n);
+    return q;
+}
+
+void larena_free_owner(lval* v);
+void larena_reset(void) {
+    if (lmem_depth) { return; }
+
+    for (long i = 0; i < larena_count; i++) {
+        lval* v = larena_owners[i];
+#ifdef LISPY_NO_SLAB
+        v->gen &= ~LARENA_OWNER;
+        if (v->type == LVAL_FREE) {
+            larena_free_owner(v);
+            continue;
+        }
+#endif
+        // it may have moved on to storage of its own since, so what counts is whether it still
+        // points into the arena
+        switch (v->type) {
+
+            case LVAL_SEXPR:
+            case LVAL_QEXPR: {
+                lval** base = v->off ? v->cell - v->off : v->cell;
+                if (larena_has(base)) {
+                    base = lmem_promote(base, sizeof(lval*) * v->cap);
+                    v->cell = base + v->off;
+                }
+            }
+            break;
+
+            case LVAL_STR:
+                if (v->str != v->sbuf && larena_has(v->str)) {
+                    v->str = lmem_promote(v->str, v->slen + 1);
+                }
+            break;
+        }
+    }
+    larena_count = 0;
+    larena_used = 0;
+}
+
+// with a quota, each top-level evaluation (a form in a file being loaded, or a line at the
+// prompt) may leave at most that many more bytes live than there were when it started
+long lmem_quota = 0;
+long lmem_base = 0;
+int lmem_crowded = 0;   // a major collection left too little of the quota free to try another
+int lmem_tripped = 0;   // it went over anyway, so everything from here on is an error
+
+void lmem_set_limit(void) {
+    lmem_limit = lmem_quota ? lmem_base + lmem_quota : LONG_MAX;
+    lmem_over = 0;
+    lmem_rise();
+    lmem_tripped = 0;
+}
+
+void lmem_begin(void) {
+    lmem_base = lmem_live;
+    lmem_crowded = 0;
+    lmem_set_limit();
+}
+
+// free objects link to the next one in their second word, which leaves the first alone (for an
+// lval that is its type, see LVAL_FREE)
+#define LSLAB_NEXT(p) (*(void**)((char*)(p) + sizeof(void*)))
+
+// without slabs every object is malloc'd with one of these in front of it
+typedef struct lslab_node {
+    struct lslab_node* prev;
+    struct lslab_node* next;
+} lslab_node;
+
+typedef struct lslab {
+    size_t size;
+    void* free_list;
+    char* bump;
+    char* bump_end;
+    void* chunks;   // every chunk starts with a pointer to the previous one
+    lslab_node* nodes;
+
+    // where lslab_walk is up to
+    char* walk_chunk;
+    char* walk_p;
+    lslab_node* walk_node;
+
+    long allocs;
+    long frees;
+    long live;
+    long peak;
+} lslab;
+
+void* lslab_alloc(lslab* s) {
+    s->allocs++;
+    s->live++;
+    if (s->live > s->peak) { s->peak = s->live; }
+    lmem_add(s->size);
+
+#ifdef LISPY_NO_SLAB
+    lslab_node* n = malloc(sizeof(lslab_node) + s->size);
+    n->prev = NULL;
+    n->next = s->nodes;
+    if (s->nodes) { s->nodes->prev = n; }
+    s->nodes = n;
+    return n + 1;
+#else
+    if (s->free_list) {
+        void* p = s->free_list;
+        s->free_list = LSLAB_NEXT(p);
+        return p;
+    }
+
+    if (s->bump + s->size > s->bump_end) {
+        char* chunk = malloc(LSLAB_CHUNK);
+        *(void**)chunk = s->chunks;
+        s->chunks = chunk;
+        // keep the objects 16 byte aligned
+        s->bump = chunk + 16;
+        s->bump_end = chunk + LSLAB_CHUNK;
+    }
+
+    void* p = s->bump;
+    s->bump += s->size;
+    return p;
+#endif
+}
+
+void lslab_free(lslab* s, void* p) {
+    s->frees++;
+    s->live--;
+    lmem_live -= s->size;
+
+#ifdef LISPY_NO_SLAB
+    lslab_node* n = (lslab_node*)p - 1;
+    if (n == s->walk_node) { s->walk_node = n->next; }
+    if (n->prev) { n->prev->next = n->next; } else { s->nodes = n->next; }
+    if (n->next) { n->next->prev = n->prev; }
+    free(n);
+#else
+    LSLAB_NEXT(p) = s->free_list;
+    s->free_list = p;
+#endif
+}
+
+// calls fn on every object handed out by s. with slabs that includes the freed ones, which fn
+// has to recognise for itself
+void lslab_each(lslab* s, void (*fn)(void*)) {
+#ifdef LISPY_NO_SLAB
+    for (lslab_node* n = s->nodes; n; n = n->next) { fn(n + 1); }
+#else
+    for (char* c = s->chunks; c; c = *(void**)c) {
+        // older chunks were filled up until the next object didn't fit
+        char* end = (c == s->chunks) ? s->bump : c + 16 + (LSLAB_CHUNK - 16) / s->size * s->size;
+        for (char* p = c + 16; p < end; p += s->size) { fn(p); }
+    }
+#endif
+}
 
-    char* err;
-    char* sym;
-    char* str;
+// lslab_walk calls fn on up to n more of the objects that were around at the last
+// lslab_walk_start (objects handed out since then may or may not be included), and returns 0
+// once it has been through them all. it's fine to alloc and free in between
+void lslab_walk_start(lslab* s) {
+    s->walk_chunk = s->chunks;
+    s->walk_p = s->chunks ? (char*)s->chunks + 16 : NULL;
+    s->walk_node = s->nodes;
+}
+
+int lslab_walk(lslab* s, long n, void (*fn)(void*)) {
+#ifdef LISPY_NO_SLAB
+    while (s->walk_node && n-- > 0) {
+        lslab_node* node = s->walk_node;
+        s->walk_node = node->next;
+        fn(node + 1);
+    }
+    return s->walk_node != NULL;
+#else
+    while (s->walk_chunk && n > 0) {
+        char* c = s->walk_chunk;
+        char* end = (c == s->chunks) ? s->bump : c + 16 + (LSLAB_CHUNK - 16) / s->size * s->size;
+        for (; s->walk_p < end && n > 0; s->walk_p += s->size, n--) { fn(s->walk_p); }
+        if (s->walk_p >= end) {
+            s->walk_chunk = *(void**)c;
+            s->walk_p = s->walk_chunk ? s->walk_chunk + 16 : NULL;
+        }
+    }
+    return s->walk_chunk != NULL;
+#endif
+}
+
+// give all the chunks back, everything allocated from s is gone after this
+void lslab_cleanup(lslab* s) {
+    while (s->chunks) {
+        void* next = *(void**)s->chunks;
+        free(s->chunks);
+        s->chunks = next;
+    }
+    s->free_list = NULL;
+    s->bump = s->bump_end = NULL;
+}
+
+lslab lval_slab = { .size = sizeof(lval) };
+
+// the garbage collector (see lgc_collect) is generational. containers start out young, and a
+// minor collection only looks at the ones made since the last collection, once LGC_YOUNG of
+// them have been. those that survive are old, and only a major collection, once the number of
+// live lvals has doubled (and is at least LGC_MIN), looks at those again. the evaluators
+// collect at their next safe point once lgc_pending says which. with a budget (see lgc_step)
+// the major collections are incremental instead. building with tiny -DLGC_MIN or -DLGC_YOUNG
+// makes it collect all the time, which is good for shaking out bugs, and -DLGC_BUDGET sets the
+// budget to start with
+#ifndef LGC_MIN
+#define LGC_MIN 100000
+#endif
+#ifndef LGC_YOUNG
+#define LGC_YOUNG 65536
+#endif
+#ifndef LGC_BUDGET
+#define LGC_BUDGET 0
+#endif
+
+enum { LGC_YOUNG_GEN, LGC_OLD_GEN };
+enum { LGC_NONE, LGC_MINOR, LGC_MAJOR };
+
+// the rest of gen is flags for the collector: SEEN while a collection is looking at an object,
+// INC while it is in an incremental one's set, and IMARK once that has found it to be live
+#define LGC_SEEN 2
+#define LGC_INC 4
+#define LGC_IMARK 8
+
+long lgc_threshold = LGC_MIN;
+long lgc_young_max = LGC_YOUNG;
+long lgc_budget = LGC_BUDGET;   // steps in an incremental slice, or 0 to collect in one go
+int lgc_pending = LGC_NONE;
+void lgc_collect(void);
+void lgc_defer(lval* v);
+
+// the containers made since the last collection. freed ones stay listed (and may have been
+// reused, even more than once), the collector sorts that out. without slabs they would be
+// dangling, so the list isn't kept and the slab is walked for young objects instead
+lval** lgc_young = NULL;
+int lgc_young_count = 0;
+int lgc_young_cap = 0;
+
+void lgc_young_add(lval* v) {
+#ifndef LISPY_NO_SLAB
+    if (lgc_young_count == lgc_young_cap) {
+        lgc_young_cap = lgc_young_cap ? lgc_young_cap * 2 : 1024;
+        lgc_young = realloc(lgc_young, sizeof(lval*) * lgc_young_cap);
+    }
+    lgc_young[lgc_young_count] = v;
+#endif
+    if (++lgc_young_count >= lgc_young_max && !lgc_pending) { lgc_pending = LGC_MINOR; }
+}
+
+lval* lval_alloc(void) {
+    if (lval_slab.live >= lgc_threshold) { lgc_pending = LGC_MAJOR; }
+    lval* v = lslab_alloc(&lval_slab);
+    v->gen = LGC_YOUNG_GEN;
+    return v;
+}
+
+void lval_free(lval* v) {
+    v->type = LVAL_FREE;
+#ifdef LISPY_NO_SLAB
+    // gone as far as lmem_live and the counts are concerned, it only stays allocated
+    if (v->gen & LARENA_OWNER) {
+        lmem_live -= sizeof(lval);
+        lval_slab.live--;
+        lval_slab.frees++;
+        return;
+    }
+#endif
+    // the incremental collector still has a pointer to v, so it has to stay unused until then
+    if (v->gen & LGC_INC) {
+        lgc_defer(v);
+        return;
+    }
+    lslab_free(&lval_slab, v);
+}
+
+// an owner lval_free left for larena_reset, counted back in so that it can really be freed
+void larena_free_owner(lval* v) {
+    lmem_live += sizeof(lval);
+    lval_slab.live++;
+    lval_slab.frees--;
+    lval_free(v);
+}
+
+/* Symbol Interning */
+// every symbol name is stored exactly once in this table, so LVAL_SYMs (and env bindings)
+// just point at the canonical copy. two symbols are the same iff their pointers are equal.
+// the name is the tail of an lsym record, which keeps track of where the symbol is bound
+
+typedef struct lsym {
+    int frames;     // how many envs other than the global one currently bind it
+    int global;     // its position in the global env, -1 if it isn't defined there
+    int folded;     // some call to it was folded to a constant (see lval_fold)
+    char name[];
+} lsym;
+
+#define LSYM(s) ((lsym*)((s) - offsetof(lsym, name)))
+
+char** lsym_table = NULL;
+int lsym_size = 0;
+int lsym_count = 0;
 
-    lbuiltin builtin;   
-    lenv* env;
-    lval* formals;
-    lval* body;
+// interned "&", used for variadic formals
+char* lsym_amp;
 
+// FNV-1a, good enough for short symbol names
+unsigned lsym_hash(char* s) {
+    unsigned h = 2166136261u;
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h;
+}
+
+void lsym_table_insert(char* s) {
+    unsigned mask = lsym_size - 1;
+    unsigned h = lsym_hash(s) & mask;
+    while (lsym_table[h]) { h = (h + 1) & mask; }
+    lsym_table[h] = s;
+}
+
+// returns the canonical copy of s, adding it to the table if this is the first time we see it
+char* lsym_intern(char* s) {
+    if (lsym_size) {
+        unsigned mask = lsym_size - 1;
+        unsigned h = lsym_hash(s) & mask;
+        while (lsym_table[h]) {
+            if (strcmp(lsym_table[h], s) == 0) { return lsym_table[h]; }
+            h = (h + 1) & mask;
+        }
+    }
+
+    // keep the table at most half full
+    if ((lsym_count + 1) * 2 > lsym_size) {
+        char** old = lsym_table;
+        int old_size = lsym_size;
+
+        lsym_size = lsym_size ? lsym_size * 2 : 256;
+        lsym_table = calloc(lsym_size, sizeof(char*));
+        for (int i = 0; i < old_size; i++) {
+            if (old[i]) { lsym_table_insert(old[i]); }
+        }
+        free(old);
+    }
+
+    lsym* c = malloc(sizeof(lsym) + strlen(s) + 1);
+    c->frames = 0;
+    c->global = -1;
+    c->folded = 0;
+    strcpy(c->name, s);
+    lsym_table_insert(c->name);
+    lsym_count++;
+    return c->name;
+}
+
+void lsym_init(void) {
+    lsym_amp = lsym_intern("&");
+}
+
+void lsym_cleanup(void) {
+    for (int i = 0; i < lsym_size; i++) {
+        if (lsym_table[i]) { free(LSYM(lsym_table[i])); }
+    }
+    free(lsym_table);
+    lsym_table = NULL;
+    lsym_size = lsym_count = 0;
+}
+
+/* Bignums */
+// a Number is kept in a long until arithmetic on it overflows, then it becomes an lbig: a sign
+// and a magnitude in base 2^32 limbs, least significant first, with no leading zero limbs.
+// lbigs aren't changed once they are made, and any result that fits in a long again goes back
+// to being one, so a Number is only big when it has to be
+
+struct lbig {
+    int neg;
     int count;
-    lval** cell;
+    int cap;    // limbs allocated, count can come down from it
+    uint32_t d[];
 };
-  
+
+// below this many limbs schoolbook multiplication beats Karatsuba
+#define LBIG_KARATSUBA_MIN 32
+
+long lbig_bytes(lbig* b) { return sizeof(lbig) + sizeof(uint32_t) * b->cap; }
+
+void lbig_del(lbig* b) { lmem_free(b, lbig_bytes(b)); }
+
+lbig* lbig_new(int count) {
+    lbig* b = lmem_alloc(sizeof(lbig) + sizeof(uint32_t) * count);
+    b->neg = 0;
+    b->count = count;
+    b->cap = count;
+    memset(b->d, 0, sizeof(uint32_t) * count);
+    return b;
+}
+
+lbig* lbig_copy(lbig* b) {
+    lbig* x = lmem_alloc(sizeof(lbig) + sizeof(uint32_t) * b->count);
+    memcpy(x, b, sizeof(lbig) + sizeof(uint32_t) * b->count);
+    x->cap = b->count;
+    return x;
+}
+
+// drop leading zero limbs. zero has no limbs and is never negative
+lbig* lbig_trim(lbig* b) {
+    while (b->count && !b->d[b->count-1]) { b->count--; }
+    if (!b->count) { b->neg = 0; }
+    return b;
+}
+
+lbig* lbig_from_long(long x) {
+    uint64_t m = x < 0 ? -(uint64_t)x : (uint64_t)x;
+    lbig* b = lbig_new(2);
+    b->neg = x < 0;
+    b->d[0] = (uint32_t)m;
+    b->d[1] = (uint32_t)(m >> 32);
+    return lbig_trim(b);
+}
+
+// returns whether b fits in a long, if so *x is set to it
+int lbig_to_long(lbig* b, long* x) {
+    if (b->count > 2) { return 0; }
+
+    uint64_t m = 0;
+    for (int i = b->count-1; i >= 0; i--) { m = (m << 32) | b->d[i]; }
+
+    if (!b->neg) {
+        if (m > (uint64_t)LONG_MAX) { return 0; }
+        *x = (long)m;
+        return 1;
+    }
+    if (m > (uint64_t)LONG_MAX + 1) { return 0; }
+    *x = (m == (uint64_t)LONG_MAX + 1) ? LONG_MIN : -(long)m;
+    return 1;
+}
+
+// magnitudes: r[0..rn) += x[0..xn), with xn <= rn. returns the carry out of the top limb
+uint32_t lmag_add(uint32_t* r, int rn, uint32_t* x, int xn) {
+    uint64_t c = 0;
+    int i = 0;
+    for (; i < xn; i++) {
+        c += (uint64_t)r[i] + x[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    for (; c && i < rn; i++) {
+        c += r[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    return (uint32_t)c;
+}
+
+// r[0..rn) -= x[0..xn), the caller makes sure r >= x
+void lmag_sub(uint32_t* r, int rn, uint32_t* x, int xn) {
+    uint32_t borrow = 0;
+    int i = 0;
+    for (; i < xn; i++) {
+        uint64_t t = (uint64_t)r[i] - x[i] - borrow;
+        r[i] = (uint32_t)t;
+        borrow = (t >> 32) & 1;
+    }
+    for (; borrow && i < rn; i++) {
+        uint64_t t = (uint64_t)r[i] - borrow;
+        r[i] = (uint32_t)t;
+        borrow = (t >> 32) & 1;
+    }
+}
+
+// a and b have no leading zero limbs
+int lmag_cmp(uint32_t* a, int an, uint32_t* b, int bn) {
+    if (an != bn) { return an < bn ? -1 : 1; }
+    for (int i = an-1; i >= 0; i--) {
+        if (a[i] != b[i]) { return a[i] < b[i] ? -1 : 1; }
+    }
+    return 0;
+}
+
+// r[0..an+bn) = a * b. r must not overlap a or b
+void lmag_mul(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn) {
+    if (an < bn) {
+        uint32_t* t = a; a = b; b = t;
+        int tn = an; an = bn; bn = tn;
+    }
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+
+    if (bn < LBIG_KARATSUBA_MIN) {
+        for (int i = 0; i < bn; i++) {
+            uint64_t c = 0;
+            for (int j = 0; j < an; j++) {
+                c += (uint64_t)b[i] * a[j] + r[i+j];
+                r[i+j] = (uint32_t)c;
+                c >>= 32;
+            }
+            r[i+an] = (uint32_t)c;
+        }
+        return;
+    }
+
+    // very unbalanced: multiply b by one bn sized slice of a at a time
+    if (an >= 2 * bn) {
+        uint32_t* t = malloc(sizeof(uint32_t) * 2 * bn);
+        for (int off = 0; off < an; off += bn) {
+            int n = an - off < bn ? an - off : bn;
+            lmag_mul(t, a + off, n, b, bn);
+            lmag_add(r + off, an + bn - off, t, n + bn);
+        }
+        free(t);
+        return;
+    }
+
+    // Karatsuba: with a = a1*B^m + a0 and b = b1*B^m + b0, a*b is z2*B^2m + z1*B^m + z0
+    // where z2 = a1*b1, z0 = a0*b0 and z1 = (a0+a1)*(b0+b1) - z2 - z0. b is longer than m
+    // since an < 2*bn, so both halves of both are there
+    int m = an / 2;
+    int a1n = an - m;
+    int b1n = bn - m;
+
+    lmag_mul(r, a, m, b, m);
+    lmag_mul(r + 2*m, a + m, a1n, b + m, b1n);
+
+    int sn = a1n + 1;
+    int tn = (b1n > m ? b1n : m) + 1;
+    uint32_t* s = calloc(2 * (sn + tn), sizeof(uint32_t));
+    uint32_t* t = s + sn;
+    uint32_t* z1 = t + tn;
+
+    memcpy(s, a + m, sizeof(uint32_t) * a1n);
+    lmag_add(s, sn, a, m);
+    if (b1n >= m) {
+        memcpy(t, b + m, sizeof(uint32_t) * b1n);
+        lmag_add(t, tn, b, m);
+    } else {
+        memcpy(t, b, sizeof(uint32_t) * m);
+        lmag_add(t, tn, b + m, b1n);
+    }
+
+    lmag_mul(z1, s, sn, t, tn);
+    lmag_sub(z1, sn + tn, r, 2*m);
+    lmag_sub(z1, sn + tn, r + 2*m, a1n + b1n);
+
+    // what is left of z1 fits below the top of r
+    int zn = sn + tn < an + bn - m ? sn + tn : an + bn - m;
+    lmag_add(r + m, an + bn - m, z1, zn);
+    free(s);
+}
+
+// q[0..n) = u / v, returns the remainder. q may be u
+uint32_t lmag_divmod1(uint32_t* q, uint32_t* u, int n, uint32_t v) {
+    uint64_t r = 0;
+    for (int i = n-1; i >= 0; i--) {
+        uint64_t cur = (r << 32) | u[i];
+        q[i] = (uint32_t)(cur / v);
+        r = cur % v;
+    }
+    return (uint32_t)r;
+}
+
+// q[0..m-n] = u / v by long division (Knuth's algorithm D), for m >= n >= 2 with v's top
+// limb nonzero
+void lmag_divmod(uint32_t* q, uint32_t* u, int m, uint32_t* v, int n) {
+    // normalise so that the top limb of v has its high bit set, then the estimated digits
+    // of the quotient are at most 2 too big
+    int s = __builtin_clz(v[n-1]);
+    uint32_t* vn = malloc(sizeof(uint32_t) * n);
+    uint32_t* un = malloc(sizeof(uint32_t) * (m + 1));
+    for (int i = n-1; i > 0; i--) {
+        vn[i] = (v[i] << s) | (s ? v[i-1] >> (32 - s) : 0);
+    }
+    vn[0] = v[0] << s;
+    un[m] = s ? u[m-1] >> (32 - s) : 0;
+    for (int i = m-1; i > 0; i--) {
+        un[i] = (u[i] << s) | (s ? u[i-1] >> (32 - s) : 0);
+    }
+    un[0] = u[0] << s;
+
+    const uint64_t B = (uint64_t)1 << 32;
+    for (int j = m - n; j >= 0; j--) {
+        uint64_t num = ((uint64_t)un[j+n] << 32) | un[j+n-1];
+        uint64_t qhat = num / vn[n-1];
+        uint64_t rhat = num % vn[n-1];
+        while (qhat >= B || qhat * vn[n-2] > ((rhat << 32) | un[j+n-2])) {
+            qhat--;
+            rhat += vn[n-1];
+            if (rhat >= B) { break; }
+        }
+
+        // un[j..j+n] -= qhat * vn
+        int64_t k = 0;
+        int64_t t;
+        for (int i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i+j] - k - (int64_t)(p & 0xFFFFFFFF);
+            un[i+j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j+n] - k;
+        un[j+n] = (uint32_t)t;
+
+        // qhat was still one too big, add vn back
+        q[j] = (uint32_t)qhat;
+        if (t < 0) {
+            q[j]--;
+            uint64_t c = 0;
+            for (int i = 0; i < n; i++) {
+                c += (uint64_t)un[i+j] + vn[i];
+                un[i+j] = (uint32_t)c;
+                c >>= 32;
+            }
+            un[j+n] += (uint32_t)c;
+        }
+    }
+
+    free(vn);
+    free(un);
+}
+
+// a + b, or a - b if negb is set
+lbig* lbig_addsub(lbig* a, lbig* b, int negb) {
+    int bneg = b->neg ^ negb;
+
+    if (a->neg == bneg) {
+        if (a->count < b->count) { lbig* t = a; a = b; b = t; }
+        lbig* r = lbig_new(a->count + 1);
+        memcpy(r->d, a->d, sizeof(uint32_t) * a->count);
+        lmag_add(r->d, r->count, b->d, b->count);
+        r->neg = bneg;
+        return lbig_trim(r);
+    }
+
+    // signs differ: take the smaller magnitude from the larger
+    int c = lmag_cmp(a->d, a->count, b->d, b->count);
+    if (c == 0) { return lbig_new(0); }
+
+    lbig* x = c > 0 ? a : b;
+    lbig* y = c > 0 ? b : a;
+    lbig* r = lbig_new(x->count);
+    memcpy(r->d, x->d, sizeof(uint32_t) * x->count);
+    lmag_sub(r->d, r->count, y->d, y->count);
+    r->neg = c > 0 ? a->neg : bneg;
+    return lbig_trim(r);
+}
+
+lbig* lbig_mul(lbig* a, lbig* b) {
+    if (!a->count || !b->count) { return lbig_new(0); }
+    lbig* r = lbig_new(a->count + b->count);
+    lmag_mul(r->d, a->d, a->count, b->d, b->count);
+    r->neg = a->neg ^ b->neg;
+    return lbig_trim(r);
+}
+
+// a / b truncated towards zero like C's, b is not zero
+lbig* lbig_div(lbig* a, lbig* b) {
+    if (lmag_cmp(a->d, a->count, b->d, b->count) < 0) { return lbig_new(0); }
+
+    lbig* q;
+    if (b->count == 1) {
+        q = lbig_new(a->count);
+        lmag_divmod1(q->d, a->d, a->count, b->d[0]);
+    } else {
+        q = lbig_new(a->count - b->count + 1);
+        lmag_divmod(q->d, a->d, a->count, b->d, b->count);
+    }
+    q->neg = a->neg ^ b->neg;
+    return lbig_trim(q);
+}
+
+double lbig_to_double(lbig* b) {
+    double d = 0;
+    for (int i = b->count-1; i >= 0; i--) { d = d * 4294967296.0 + b->d[i]; }
+    return b->neg ? -d : d;
+}
+
+// d must be integral, as every double at least 2^63 from zero is
+lbig* lbig_from_double(double d) {
+    int exp;
+    // |d| = mant * 2^(exp-53), with mant 53 bits wide
+    uint64_t mant = (uint64_t)ldexp(frexp(fabs(d), &exp), 53);
+    lbig* b = lbig_new((exp + 31) / 32);
+    b->neg = d < 0;
+    for (int i = 0; i < 53; i++) {
+        if ((mant >> i) & 1) {
+            int k = exp - 53 + i;
+            b->d[k / 32] |= (uint32_t)1 << (k % 32);
+        }
+    }
+    return lbig_trim(b);
+}
+
+int lbig_cmp(lbig* a, lbig* b) {
+    if (a->neg != b->neg) { return a->neg ? -1 : 1; }
+    int c = lmag_cmp(a->d, a->count, b->d, b->count);
+    return a->neg ? -c : c;
+}
+
+// decimal conversions go 9 digits (one uint32) at a time, so it is one pass over the limbs
+// per 9 digits rather than per digit
+lbig* lbig_read(char* s) {
+    int neg = (*s == '-');
+    if (neg) { s++; }
+
+    // 10^9 < 2^32, so there is never more than a limb per 9 digits
+    int len = strlen(s);
+    lbig* b = lbig_new(len / 9 + 1);
+    b->count = 0;
+
+    int chunk = len % 9 ? len % 9 : 9;
+    while (*s) {
+        uint32_t x = 0;
+        uint32_t mul = 1;
+        for (int i = 0; i < chunk; i++) {
+            x = x * 10 + (s[i] - '0');
+            mul *= 10;
+        }
+        s += chunk;
+        chunk = 9;
+
+        // b = b * mul + x
+        uint64_t c = x;
+        for (int i = 0; i < b->count; i++) {
+            c += (uint64_t)b->d[i] * mul;
+            b->d[i] = (uint32_t)c;
+            c >>= 32;
+        }
+        if (c) { b->d[b->count++] = (uint32_t)c; }
+    }
+
+    b->neg = neg;
+    return lbig_trim(b);
+}
+
+// the decimal digits of b as a new string
+char* lbig_str(lbig* b) {
+    int n = b->count;
+    uint32_t* t = malloc(sizeof(uint32_t) * (n + 1));
+    memcpy(t, b->d, sizeof(uint32_t) * n);
+
+    // each limb is less than 10 decimal digits, so at most 2 chunks of 9
+    uint32_t* chunks = malloc(sizeof(uint32_t) * (2 * n + 1));
+    int k = 0;
+    while (n) {
+        chunks[k++] = lmag_divmod1(t, t, n, 1000000000);
+        while (n && !t[n-1]) { n--; }
+    }
+
+    char* s = malloc(9 * k + 12);
+    char* p = s;
+    if (b->neg) { *p++ = '-'; }
+    p += sprintf(p, "%u", k ? chunks[k-1] : 0);
+    for (int i = k-2; i >= 0; i--) {
+        p += sprintf(p, "%09u", chunks[i]);
+    }
+
+    free(t);
+    free(chunks);
+    return s;
+}
 
 // init all types with constructor functions
 
+// small numbers are preallocated once and shared, so (most) arithmetic and every
+// comparison result needs no allocation at all. the table holds one reference to each
+// entry itself, so they never get freed
+#define LVAL_SMALL_MIN -128
+#define LVAL_SMALL_MAX 1023
+
+lval lval_small_nums[LVAL_SMALL_MAX - LVAL_SMALL_MIN + 1];
+
+void lval_init(void) {
+    larena = malloc(LARENA_SIZE);
+    larena_owners = malloc(sizeof(lval*) * (LARENA_SIZE / 8));
+    for (long i = LVAL_SMALL_MIN; i <= LVAL_SMALL_MAX; i++) {
+        lval* v = &lval_small_nums[i - LVAL_SMALL_MIN];
+        v->type = LVAL_NUM;
+        v->refs = 1;
+        v->num = i;
+        v->big = NULL;
+    }
+}
+
+lval* lval_copy(lval* v);
+
 lval* lval_num (long x) {
-    lval* v = malloc(sizeof(lval));
+    if (x >= LVAL_SMALL_MIN && x <= LVAL_SMALL_MAX) {
+        return lval_copy(&lval_small_nums[x - LVAL_SMALL_MIN]);
+    }
+
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_NUM;
     v->num = x;
+    v->big = NULL;
+    return v;
+}
+
+lval* lval_dbl(double x) {
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_DBL;
+    v->dbl = x;
+    return v;
+}
+
+// writes the shortest of %.15g to %.17g that reads back as the same double into buf (which
+// has room for 40), with a '.' added if need be so that it reads back as a Float rather than
+// a Number
+void lval_dbl_fmt(double d, char* buf) {
+    for (int p = 15; p <= 17; p++) {
+        snprintf(buf, 40, "%.*g", p, d);
+        if (strtod(buf, NULL) == d) { break; }
+    }
+    if (!strpbrk(buf, ".ein")) { strcat(buf, ".0"); }
+}
+
+// takes ownership of b. it only stays big if it doesn't fit in a long
+lval* lval_big(lbig* b) {
+    long x;
+    if (lbig_to_long(b, &x)) {
+        lbig_del(b);
+        return lval_num(x);
+    }
+
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_NUM;
+    v->num = 0;
+    v->big = b;
     return v;
 }
 
 lval* lval_err(char* fmt, ...) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_ERR;
     
     va_list va;
     va_start(va, fmt);
 
-    v->err = malloc(512);
+    v->err = lmem_alloc(512);
 
     vsnprintf(v->err, 511, fmt, va);
-    v->err = realloc(v->err, strlen(v->err) + 1);
+    v->err = lmem_realloc(v->err, 512, strlen(v->err) + 1);
 
     va_end(va);
 
@@ -94,86 +1139,222 @@ char* ltype_name(int t) {
     switch(t) {
         case LVAL_FUN: return "Function";
         case LVAL_NUM: return "Number";
+        case LVAL_DBL: return "Float";
         case LVAL_ERR: return "Error";
         case LVAL_SYM: return "Symbol";
         case LVAL_STR: return "String";
         case LVAL_SEXPR: return "S-Expression";
         case LVAL_QEXPR: return "Q-Expression";
+        case LVAL_VEC: return "Vector";
+        case LVAL_MAP: return "Map";
+        case LVAL_BUILDER: return "Builder";
         default: return "Unknown";
     }
 }
 
 lval* lval_sym(char* s) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_SYM;
-    v->sym = malloc(strlen(s) + 1);
-    strcpy(v->sym, s);
+    v->sym = lsym_intern(s);
+    v->slot = -1;
     return v;
 }
 
-lval* lval_str(char* s) {
-    lval* v = malloc(sizeof(lval));
+// gives v room for a string of n chars, which the caller fills in
+void lval_str_init(lval* v, int n) {
+    v->slen = n;
+    v->str = n < LVAL_SSO ? v->sbuf : lmem_alloc_in(v, n + 1);
+    v->str[n] = '\0';
+}
+
+// a string of n chars for the caller to fill in
+lval* lval_str_new(int n) {
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_STR;
-    v->str = malloc(strlen(s) + 1);
-    strcpy(v->str, s);
+    lval_str_init(v, n);
+    return v;
+}
+
+lval* lval_str_n(char* s, int n) {
+    lval* v = lval_str_new(n);
+    memcpy(v->str, s, n);
+    return v;
+}
+
+lval* lval_str(char* s) {
+    return lval_str_n(s, strlen(s));
+}
+
+// builders are mutable strings for building up text a piece at a time: appending grows the
+// buffer geometrically, so n appends cost O(total length) rather than the O(n * length) of
+// concatenating strings, and the text is only copied into a String once, by sb-str. like
+// vectors and maps they are shared by reference
+lval* lval_builder(void) {
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_BUILDER;
+    v->blen = 0;
+    v->bcap = 64;
+    v->bbuf = lmem_alloc(v->bcap);
     return v;
 }
 
+// make room for n more chars, where b->blen + n is less than INT_MAX. 0 if it can't, and b is
+// left as it was
+int lval_builder_grow(lval* b, int n) {
+    if (b->blen + n > b->bcap) {
+        long cap = b->bcap;
+        while (b->blen + n > cap) { cap *= 2; }
+        if (cap > INT_MAX) { cap = INT_MAX; }
+        char* buf = lmem_try_realloc(b->bbuf, b->bcap, cap);
+        if (!buf) { return 0; }
+        b->bbuf = buf;
+        b->bcap = cap;
+    }
+    return 1;
+}
+
 lval* lval_fun(lbuiltin func) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_FUN;
     v->builtin = func;
     return v;
 }
 
 lval* lval_sexpr(void) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_SEXPR;
+    lgc_young_add(v);
     v->count = 0;
+    v->cap = 0;
+    v->off = 0;
     v->cell = NULL;
+    v->code = NULL;
     return v;
 } 
 
 lval* lval_qexpr(void) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lval_alloc();
+    v->refs = 1;
     v->type = LVAL_QEXPR;
+    lgc_young_add(v);
     v->count = 0;
+    v->cap = 0;
+    v->off = 0;
     v->cell = NULL;
+    v->code = NULL;
     return v;
 }
 
-lenv* lenv_new(void);
+// vectors are fixed length arrays which, unlike lists, are changed in place (by vec-set! and
+// vec-fill!), so every reference to one sees the change. while every element is a Number that
+// fits in a long, or every element is a Float, they are kept unboxed. storing anything else
+// turns the vector into an array of lvals.
+// n is up to the program, so this is NULL when there isn't the memory for that many
+lval* lval_vec(int kind, int n) {
+    long* cells = lmem_try_calloc(n + 1, sizeof(long));
+    if (!cells) { return NULL; }
+
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_VEC;
+    lgc_young_add(v);
+    v->vlen = n;
+    v->vkind = kind;
+    v->vints = cells;
+    return v;
+}
 
-lval* lval_lambda(lval* formals, lval* body) {
-    lval* v = malloc(sizeof(lval));
-    v->type = LVAL_FUN;
+// the elements are all a word whatever they are stored as, plus one spare
+long lvec_bytes(lval* v) { return sizeof(long) * (v->vlen + 1); }
 
-    v->builtin = NULL;
+// how x would be stored in a vector of its own
+int lvec_kind(lval* x) {
+    if (x->type == LVAL_NUM && !x->big) { return LVEC_INT; }
+    if (x->type == LVAL_DBL) { return LVEC_DBL; }
+    return LVEC_ANY;
+}
 
-    v->env = lenv_new();
+lval* lval_dbl(double x);
 
-    v->formals = formals;
-    v->body = body;
-    return v;
+lval* lval_vec_get(lval* v, int i) {
+    switch (v->vkind) {
+        case LVEC_INT: return lval_num(v->vints[i]);
+        case LVEC_DBL: return lval_dbl(v->vdbls[i]);
+        default: return lval_copy(v->vcells[i]);
+    }
 }
 
-// destructor for lval, frees the memory used by the lval after used
-void lenv_del(lenv* e);
-void lval_del(lval* v) {
-    switch (v->type) {
-        // for nums the type is long so nothing special
-        case LVAL_NUM: break;
-        // err and sym are strings so freeing is straightforward
-        case LVAL_ERR: free(v->err); break;
-        case LVAL_SYM: free(v->sym); break;
-        case LVAL_STR: free(v->str); break;
-        // sexprs are lists so we need to free each element and then the mem used to store the pointers
-        case LVAL_QEXPR:
+// box every element, so that anything can be stored
+void lval_vec_box(lval* v) {
+    if (v->vkind == LVEC_ANY) { return; }
+
+    lval** cells = lmem_alloc(sizeof(lval*) * (v->vlen + 1));
+    for (int i = 0; i < v->vlen; i++) { cells[i] = lval_vec_get(v, i); }
+
+    lmem_free(v->vints, lvec_bytes(v));
+    v->vcells = cells;
+    v->vkind = LVEC_ANY;
+}
+
+void lval_del(lval* v);
+
+// stores x (which it takes ownership of) at i
+void lval_vec_put(lval* v, int i, lval* x) {
+    if (v->vkind != LVEC_ANY && lvec_kind(x) != v->vkind) { lval_vec_box(v); }
+
+    switch (v->vkind) {
+        case LVEC_INT: v->vints[i] = x->num; lval_del(x); break;
+        case LVEC_DBL: v->vdbls[i] = x->dbl; lval_del(x); break;
+        default: lval_del(v->vcells[i]); v->vcells[i] = x; break;
+    }
+}
+
+lenv* lenv_new(void);
+
+lval* lval_lambda(lval* formals, lval* body) {
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_FUN;
+    lgc_young_add(v);
+
+    v->builtin = NULL;
+
+    v->env = lenv_new();
+
+    v->formals = formals;
+    v->body = body;
+    return v;
+}
+
+// destructor for lval, frees the memory used by the lval after used
+void lenv_del(lenv* e);
+void lchunk_del(lchunk* c);
+void lmap_del(lmap* m);
+void lval_del(lval* v) {
+    // someone else still holds a reference, only drop ours
+    if (--v->refs > 0) { return; }
+
+    switch (v->type) {
+        // for nums the type is long so nothing special, unless it is big
+        case LVAL_NUM: if (v->big) { lbig_del(v->big); } break;
+        case LVAL_DBL: break;
+        // err is a string so freeing is straightforward, syms point into the intern table and aren't ours to free
+        case LVAL_ERR: lmem_free(v->err, strlen(v->err) + 1); break;
+        case LVAL_SYM: break;
+        case LVAL_STR: if (v->str != v->sbuf) { lmem_free(v->str, v->slen + 1); } break;
+        // sexprs are lists so we need to free each element and then the mem used to store the pointers
+        case LVAL_QEXPR:
         case LVAL_SEXPR:
             for (int i = 0; i < v->count; i++) {
                 lval_del(v->cell[i]);
             }
-            free(v->cell);
+            lmem_free(v->off ? v->cell - v->off : v->cell, sizeof(lval*) * v->cap);
+            if (v->code) { lchunk_del(v->code); }
         break;
 
         case LVAL_FUN:
@@ -183,30 +1364,84 @@ void lval_del(lval* v) {
                 lval_del(v->body);
             }
         break;
+
+        case LVAL_VEC:
+            if (v->vkind == LVEC_ANY) {
+                for (int i = 0; i < v->vlen; i++) { lval_del(v->vcells[i]); }
+            }
+            lmem_free(v->vints, lvec_bytes(v));
+        break;
+
+        case LVAL_MAP: lmap_del(v->map); break;
+        case LVAL_BUILDER: lmem_free(v->bbuf, v->bcap); break;
     }
     // free the mem used to store the lval struct
-    free(v);
+    lval_free(v);
+}
+
+
+// make sure there is room for n more cells after the last one
+void lval_reserve(lval* v, int n) {
+    if (v->off + v->count + n <= v->cap) { return; }
+
+    lval** base = v->off ? v->cell - v->off : v->cell;
+
+    // plenty of space left at the front from popping, slide everything back down instead
+    if (v->count + n <= v->cap && v->off >= v->cap / 2) {
+        memmove(base, v->cell, sizeof(lval*) * v->count);
+        v->cell = base;
+        v->off = 0;
+        return;
+    }
+
+    // grow geometrically so that appending is amortised O(1)
+    int cap = v->cap ? v->cap * 2 : 4;
+    while (cap < v->off + v->count + n) { cap *= 2; }
+
+    if (base && !larena_has(base)) {
+        base = lmem_realloc(base, sizeof(lval*) * v->cap, sizeof(lval*) * cap);
+    } else {
+        lval** cells = lmem_alloc_in(v, sizeof(lval*) * cap);
+        if (base) { memcpy(cells, base, sizeof(lval*) * (v->off + v->count)); }
+        lmem_free(base, sizeof(lval*) * v->cap);
+        base = cells;
+    }
+    v->cell = base + v->off;
+    v->cap = cap;
 }
 
+// any compiled code for a list is stale once the list changes
+void lval_drop_code(lval* v) {
+    if (v->code) {
+        lchunk_del(v->code);
+        v->code = NULL;
+    }
+}
 
+// lval_add/lval_pop/lval_take change v in place, so v must be owned (see lval_own)
 lval* lval_add(lval* v, lval* x) {
-    v->count++;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
-    v->cell[v->count-1] = x;
+    lval_drop_code(v);
+    lval_reserve(v, 1);
+    v->cell[v->count++] = x;
     return v;
 }
 
-// pops out ith value and shifts rest upwards
+// pops out ith value and shifts rest upwards. the array never shrinks
 lval* lval_pop(lval* v, int i) {
     lval* x = v->cell[i];
+    lval_drop_code(v);
 
-    // use memmove here instead of memcopy in case destination and source overlap. Remember- params: destination, source, size.
-    memmove(&v->cell[i], &v->cell[i+1],
-        sizeof(lval*) * (v->count-i-1));
+    if (i == 0) {
+        // popping the front just moves the start of the array along, no copying
+        v->cell++;
+        v->off++;
+    } else {
+        // use memmove here instead of memcopy in case destination and source overlap. Remember- params: destination, source, size.
+        memmove(&v->cell[i], &v->cell[i+1],
+            sizeof(lval*) * (v->count-i-1));
+    }
 
-    // reduce count and reallocate memory of popped value
     v->count--;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
 
     // return the popped value
     return x;
@@ -221,29 +1456,56 @@ lval* lval_take(lval* v, int i) {
 
 lenv* lenv_copy(lenv* e);
 
+// values are shared, so a "copy" is just another reference
 lval* lval_copy(lval* v) {
-    lval* x = malloc(sizeof(lval));
+    v->refs++;
+    return v;
+}
+
+// make sure we hold the only reference to v before changing it in place. if it is shared we
+// make a shallow copy: the new lval gets its own cell array but shares the children, which are
+// in turn only copied if and when they get changed (copy-on-write)
+lval* lval_own(lval* v) {
+    // vectors, maps and builders are shared by reference on purpose, changes to one are meant
+    // to be seen by all
+    if (v->type == LVAL_VEC || v->type == LVAL_MAP || v->type == LVAL_BUILDER) { return v; }
+
+    if (v->refs == 1) {
+        if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) { lval_drop_code(v); }
+        return v;
+    }
+
+    lval* x = lval_alloc();
     x->type = v->type;
+    x->refs = 1;
+    if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) { lgc_young_add(x); }
 
     switch (v->type) {
-        case LVAL_NUM: x->num = v->num; break;
+        case LVAL_NUM:
+            x->num = v->num;
+            x->big = v->big ? lbig_copy(v->big) : NULL; break;
+
+        case LVAL_DBL: x->dbl = v->dbl; break;
 
         case LVAL_ERR:
-            x->err = malloc(strlen(v->err)+1);
+            x->err = lmem_alloc(strlen(v->err)+1);
             strcpy(x->err, v->err); break;
 
         case LVAL_SYM:
-            x->sym = malloc(strlen(v->sym)+1);
-            strcpy(x->sym, v->sym); break;
+            x->sym = v->sym;
+            x->slot = v->slot; break;
 
         case LVAL_STR:
-            x->str = malloc(strlen(v->str)+1);
-            strcpy(x->str, v->str); break;
+            lval_str_init(x, v->slen);
+            memcpy(x->str, v->str, v->slen); break;
 
         case LVAL_SEXPR:
         case LVAL_QEXPR:
             x->count = v->count;
-            x->cell = malloc(sizeof(lval*) * x->count);
+            x->cap = v->count;
+            x->off = 0;
+            x->code = NULL;
+            x->cell = lmem_alloc_in(x, sizeof(lval*) * x->count);
             for (int i=0; i < x->count; i++) {
                 x->cell[i] = lval_copy(v->cell[i]);
             }
@@ -260,639 +1522,3681 @@ lval* lval_copy(lval* v) {
             }
         break;
     } 
+
+    lval_del(v);
+    return x;
+}
+
+lval* lval_join(lenv* e, lval* x, lval* y) {
+    x = lval_own(x);
+    lval_reserve(x, y->count);
+    for (int i = 0; i < y->count; i++) {
+        x = lval_add(x, lval_copy(y->cell[i]));
+    }
+
+    lval_del(y);
+    return x;
+}
+
+/* Lisp Environment */
+// stores data on names & vals relationships of variables in the code 
+// syms/vals are kept in insertion order; once an env grows past LENV_INDEX_MIN
+// entries we also keep an open-addressing hash index over them, so lookups in
+// big envs (i.e. the global env) don't have to scan every name.
+// syms are interned, so they are compared (and hashed) by pointer
+
+#define LENV_INDEX_MIN 8
+
+struct lenv {
+    lenv* parent; // we use this so that we can refer to builtin fns in the global env 
+    int count;
+    int cap;
+    char** syms;
+    lval** vals;
+    // syms/vals are a slice of the frame stack rather than malloc'd
+    int stacked;
+
+    // index slots hold (position in syms/vals)+1, 0 means empty. size is a power of 2
+    int index_size;
+    int* index;
+};
+
+// the top level env that def binds into. its bindings are tracked through lsym.global, every
+// other env's through lsym.frames
+lenv* lenv_globals = NULL;
+
+lslab lenv_slab = { .size = sizeof(lenv) };
+
+lenv* lenv_alloc(void) { return lslab_alloc(&lenv_slab); }
+void lenv_free(lenv* e) { lslab_free(&lenv_slab, e); }
+
+// the frames made for lambda calls take their syms/vals from one contiguous stack instead of
+// malloc. a call's frame is always gone before its caller's, so releasing one is just moving
+// lframe_top back down. a frame that has to grow while it isn't on top, or that outlives its
+// call (i.e. it ends up in a partially applied function), is moved out onto the heap
+#define LFRAME_SLOTS (1 << 18)
+
+char** lframe_syms = NULL;
+lval** lframe_vals = NULL;
+int lframe_top = 0;
+
+int lframe_on_top(lenv* e) {
+    return e->stacked && e->syms + e->cap == lframe_syms + lframe_top;
+}
+
+// syms are interned, so hashing the pointer is enough
+unsigned lenv_hash(char* sym) {
+    uintptr_t p = (uintptr_t)sym;
+    return (unsigned)((p >> 4) * 2654435761u);
+}
+
+lenv* lenv_new(void) {
+    lenv* e = lenv_alloc();
+    e->parent = NULL;
+    e->count = 0;
+    e->cap = 0;
+    e->syms = NULL;
+    e->vals = NULL;
+    e->stacked = 0;
+    e->index_size = 0;
+    e->index = NULL;
+    return e;
+}
+
+// an env with room for n bindings on the frame stack. if the stack is full it just starts
+// out empty on the heap like any other env
+lenv* lenv_frame(int n) {
+    lenv* e = lenv_new();
+    if (!lframe_syms) {
+        lframe_syms = malloc(sizeof(char*) * LFRAME_SLOTS);
+        lframe_vals = malloc(sizeof(lval*) * LFRAME_SLOTS);
+    }
+    if (lframe_top + n <= LFRAME_SLOTS) {
+        e->syms = lframe_syms + lframe_top;
+        e->vals = lframe_vals + lframe_top;
+        e->cap = n;
+        e->stacked = 1;
+        lframe_top += n;
+    }
+    return e;
+}
+
+// move a frame's bindings off the frame stack into malloc'd arrays with room for cap
+void lenv_unstack(lenv* e, int cap) {
+    if (!e->stacked) { return; }
+
+    char** syms = lmem_alloc(sizeof(char*) * cap);
+    lval** vals = lmem_alloc(sizeof(lval*) * cap);
+    memcpy(syms, e->syms, sizeof(char*) * e->count);
+    memcpy(vals, e->vals, sizeof(lval*) * e->count);
+    if (lframe_on_top(e)) { lframe_top -= e->cap; }
+
+    e->syms = syms;
+    e->vals = vals;
+    e->cap = cap;
+    e->stacked = 0;
+}
+
+// make room for one more binding
+void lenv_grow(lenv* e) {
+    if (e->count < e->cap) { return; }
+
+    // a frame on top of the stack can just take the next slot
+    if (lframe_on_top(e) && lframe_top < LFRAME_SLOTS) {
+        e->cap++;
+        lframe_top++;
+        return;
+    }
+
+    int cap = e->cap ? e->cap * 2 : 4;
+    if (e->stacked) {
+        lenv_unstack(e, cap);
+        return;
+    }
+    e->syms = lmem_realloc(e->syms, sizeof(char*) * e->cap, sizeof(char*) * cap);
+    e->vals = lmem_realloc(e->vals, sizeof(lval*) * e->cap, sizeof(lval*) * cap);
+    e->cap = cap;
+}
+
+void lenv_del(lenv* e) {
+    for (int i=0; i < e->count; i++) {
+        lval_del(e->vals[i]); // del because vals is an lval struct. del frees for all cases; using free would lead to potential memory leaks
+        if (e != lenv_globals) { LSYM(e->syms[i])->frames--; }
+    }
+    if (e->stacked) {
+        if (lframe_on_top(e)) { lframe_top -= e->cap; }
+    } else {
+        lmem_free(e->syms, sizeof(char*) * e->cap);
+        lmem_free(e->vals, sizeof(lval*) * e->cap);
+    }
+    lmem_free(e->index, sizeof(int) * e->index_size);
+    lenv_free(e);
+}
+
+// insert position i of syms/vals into the index. caller makes sure there is room
+void lenv_index_insert(lenv* e, int i) {
+    unsigned mask = e->index_size - 1;
+    unsigned h = lenv_hash(e->syms[i]) & mask;
+    while (e->index[h]) { h = (h + 1) & mask; }
+    e->index[h] = i + 1;
+}
+
+// (re)build the index so that it stays at most half full
+void lenv_index_grow(lenv* e) {
+    int size = e->index_size ? e->index_size : 16;
+    while (size < e->count * 2) { size *= 2; }
+
+    lmem_free(e->index, sizeof(int) * e->index_size);
+    e->index_size = size;
+    e->index = lmem_calloc(size, sizeof(int));
+    for (int i = 0; i < e->count; i++) {
+        lenv_index_insert(e, i);
+    }
+}
+
+// returns the position of sym in e's own bindings, or -1. doesn't look at parents
+int lenv_find(lenv* e, char* sym) {
+    if (!e->index) {
+        for (int i=0; i < e->count; i++) {
+            if (e->syms[i] == sym) { return i; }
+        }
+        return -1;
+    }
+
+    unsigned mask = e->index_size - 1;
+    unsigned h = lenv_hash(sym) & mask;
+    while (e->index[h]) {
+        int i = e->index[h] - 1;
+        if (e->syms[i] == sym) { return i; }
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+// since we have an lval type that creates envs, and we can copy that lval type, we need to also be able to copy lenv types.
+// the values themselves are shared with e
+lenv* lenv_copy(lenv* e) {
+    lenv* n = lenv_alloc();
+    n->parent = e->parent;
+    n->count = e->count;
+    n->cap = e->count;
+    n->syms = lmem_alloc(sizeof(char*) * n->count);
+    n->vals = lmem_alloc(sizeof(lval*) * n->count);
+    n->stacked = 0;
+    for (int i = 0; i < e->count; i++) {
+        n->syms[i] = e->syms[i];
+        n->vals[i] = lval_copy(e->vals[i]);
+        LSYM(n->syms[i])->frames++;
+    }
+
+    n->index_size = e->index_size;
+    n->index = NULL;
+    if (e->index) {
+        n->index = lmem_alloc(sizeof(int) * n->index_size);
+        memcpy(n->index, e->index, sizeof(int) * n->index_size);
+    }
+
+    return n;
+}
+
+lval* lenv_get(lenv* e, lval* k) {
+    // builtin_lambda resolved this to a slot of the frame, check it is still right
+    if (k->slot >= 0 && k->slot < e->count && e->syms[k->slot] == k->sym) {
+        return lval_copy(e->vals[k->slot]);
+    }
+
+    // nothing but the global env binds this name, so there is no need to look at any frames
+    lsym* s = LSYM(k->sym);
+    if (s->frames == 0) {
+        if (s->global >= 0) { return lval_copy(lenv_globals->vals[s->global]); }
+        return lval_err("Unbound symbol '%s'", k->sym);
+    }
+
+    // walk up the parents iteratively, each env is a single O(1)-ish probe
+    while (e) {
+        int i = lenv_find(e, k->sym);
+        if (i >= 0) { return lval_copy(e->vals[i]); }
+        e = e->parent;
+    }
+    return lval_err("Unbound symbol '%s'", k->sym);
+}
+
+// binds sym to v in e, taking ownership of v
+int lfold_epoch = 0;
+
+void lenv_bind_sym(lenv* e, char* sym, lval* v) {
+    // calls to sym were folded assuming it means the builtin, which may no longer be true
+    if (LSYM(sym)->folded) {
+        LSYM(sym)->folded = 0;
+        lfold_epoch++;
+    }
+
+    // see if the var already exists in this env
+    int i = lenv_find(e, sym);
+
+    // if the var exists, delete the val in that position and replace with new
+    if (i >= 0) {
+        lval_del(e->vals[i]);
+        e->vals[i] = v;
+        return;
+    }
+
+    // else if var doesn't exist, add space for it
+    lenv_grow(e);
+    e->count++;
+
+    // the symbol is interned so just point at it
+    e->vals[e->count-1] = v;
+    e->syms[e->count-1] = sym;
+
+    if (e == lenv_globals) {
+        LSYM(sym)->global = e->count-1;
+    } else {
+        LSYM(sym)->frames++;
+    }
+
+    // keep the index at most half full, start one once the env is big enough
+    if (e->index && e->count * 2 <= e->index_size) {
+        lenv_index_insert(e, e->count-1);
+    } else if (e->count >= LENV_INDEX_MIN) {
+        lenv_index_grow(e);
+    }
+}
+
+void lenv_put_sym(lenv* e, char* sym, lval* v) {
+    lenv_bind_sym(e, sym, lval_copy(v));
+}
+
+void lenv_put(lenv* e, lval* k, lval* v) {
+    lenv_put_sym(e, k->sym, v);
+}
+
+void lenv_def(lenv* e, lval* k, lval* v) {
+    // iterate till e has no parent
+    while(e->parent) {  e = e->parent;  }
+    lenv_put(e, k, v);
+}
+
+
+// forward declarations
+lval* lval_eval(lenv* e, lval* v);
+lval* builtin_op(lenv* e, lval* a, int op);
+lval* builtin(lenv* e, lval* a, char* func);
+lval* lval_read(mpc_ast_t* t);
+void lval_print(lval* v);
+void lval_println(lval* v);
+
+/* Builtins */
+
+#define LASSERT(args, cond, fmt, ...) \
+    if (!(cond)) {lval* err = lval_err(fmt, ##__VA_ARGS__); \
+    lval_del(args); return err;} 
+
+#define LASSERT_TYPE(args, func, index, expected) \
+    LASSERT(args, args->cell[index]->type == expected, \
+    "Function '%s' passed incorrect type. Got %s, expected %s.", func, ltype_name(args->cell[index]->type), ltype_name(expected))
+
+#define LASSERT_NUM(args, func, expected) \
+    LASSERT(args, args->count == expected, \
+    "Function '%s' passed incorrect num of args. Got %i, expected %i.", func, args->count, expected) 
+
+#define LASSERT_NOT_EMPTY(args, func, index) \
+    LASSERT(args, args->cell[index]->count != 0, "Function '%s' passed {} for argument %i", func, index)
+
+
+lval* builtin_head(lenv* e, lval* a) {
+    LASSERT_NUM(a, "head", 1);
+    LASSERT_TYPE(a, "head", 0, LVAL_QEXPR);
+    LASSERT_NOT_EMPTY(a, "head", 0);
+
+    lval* v = lval_own(lval_take(a, 0));
+    while (v->count > 1) { lval_del(lval_pop(v, v->count-1)); }
+    return v;
+}
+
+lval* builtin_tail(lenv* e, lval* a) {
+    LASSERT_NUM(a, "tail", 1);
+    LASSERT_TYPE(a, "tail", 0, LVAL_QEXPR);
+    LASSERT_NOT_EMPTY(a, "tail", 0);
+
+    lval* v = lval_own(lval_take(a, 0));
+    lval_del(lval_pop(v,0));
+    return v;
+}
+
+lval* builtin_list(lenv* e, lval* a) {
+    a->type = LVAL_QEXPR;
+    return a;
+}
+
+// eval is split in two: checking the args and picking out the S-Expression to evaluate, which
+// lval_eval also uses to run it as a tail call, and then actually evaluating it
+
+// the Q-Expression to evaluate, as it is (possibly shared), or an error
+lval* builtin_eval_pick(lval* a) {
+    LASSERT_TYPE(a, "eval", 0, LVAL_QEXPR);
+    LASSERT_NUM(a, "eval", 1);
+
+    return lval_take(a, 0);
+}
+
+lval* builtin_eval_expr(lval* a) {
+    lval* x = builtin_eval_pick(a);
+    if (x->type == LVAL_ERR) { return x; }
+
+    x = lval_own(x);
+    x->type = LVAL_SEXPR;
+    return x;
+}
+
+lval* builtin_eval(lenv* e, lval* a) {
+    return lval_eval(e, builtin_eval_expr(a));
+}
+
+lval* builtin_join(lenv* e, lval* a) {
+
+    for (int i=0; i < a->count; i++) {
+        LASSERT_TYPE(a, "join", i, LVAL_QEXPR);
+    }
+
+    lval* x = lval_pop(a, 0);
+
+    while (a->count) {
+        lval* y = lval_pop(a, 0);
+        x = lval_join(e,x,y);
+    }
+
+    lval_del(a);
     return x;
 }
 
-lval* lval_join(lenv* e, lval* x, lval* y) {
-    while (y->count) {
-        x = lval_add(x, lval_pop(y, 0));
+// the arithmetic and comparison builtins are told which operator they are with one of these
+// rather than by name, so picking what to do is one switch per call instead of a strcmp per
+// operand
+enum { LARITH_ADD, LARITH_SUB, LARITH_MUL, LARITH_DIV };
+enum { LCMP_LT, LCMP_GT, LCMP_LE, LCMP_GE, LCMP_EQ, LCMP_NE };
+
+char* larith_names[] = { "+", "-", "*", "/" };
+char* lcmp_names[] = { "<", ">", "<=", ">=", "==", "!=" };
+
+// carries on the reduction in builtin_op with bignums once it has gone past what a long can
+// hold. acc is the result of the args before i (or of the only arg when negating)
+lval* builtin_op_big(lval* a, int op, int i, lbig* acc) {
+    if (op == LARITH_SUB && a->count == 1) { acc->neg = !acc->neg; }
+
+    for (; i < a->count; i++) {
+        lval* y = a->cell[i];
+        lbig* b = y->big ? y->big : lbig_from_long(y->num);
+        lbig* r = NULL;
+
+        switch (op) {
+            case LARITH_ADD: r = lbig_addsub(acc, b, 0); break;
+            case LARITH_SUB: r = lbig_addsub(acc, b, 1); break;
+            case LARITH_MUL: r = lbig_mul(acc, b); break;
+            case LARITH_DIV:
+                if (!b->count) {
+                    lbig_del(acc); lbig_del(b); lval_del(a);
+                    return lval_err("Division by Zero!");
+                }
+                r = lbig_div(acc, b);
+            break;
+        }
+
+        if (!y->big) { lbig_del(b); }
+        lbig_del(acc);
+        acc = r;
+    }
+
+    lval_del(a);
+    return lval_big(acc);
+}
+
+// Numbers and Floats
+int lval_is_num(lval* v) { return v->type == LVAL_NUM || v->type == LVAL_DBL; }
+
+double lval_to_double(lval* v) {
+    if (v->type == LVAL_DBL) { return v->dbl; }
+    return v->big ? lbig_to_double(v->big) : (double)v->num;
+}
+
+// as soon as one of the args is a Float the whole reduction is done in doubles. Floats are always
+// finite, since inf and nan couldn't be read back in, so a big Number too large for a double or a
+// result that would be inf is an error instead
+lval* builtin_op_dbl(lval* a, int op) {
+    for (int i = 0; i < a->count; i++) {
+        LASSERT(a, isfinite(lval_to_double(a->cell[i])), "Number too big to convert to Float!");
+    }
+
+    double x = lval_to_double(a->cell[0]);
+    if (op == LARITH_SUB && a->count == 1) { x = -x; }
+
+    for (int i = 1; i < a->count; i++) {
+        double y = lval_to_double(a->cell[i]);
+        switch (op) {
+            case LARITH_ADD: x += y; break;
+            case LARITH_SUB: x -= y; break;
+            case LARITH_MUL: x *= y; break;
+            case LARITH_DIV:
+                if (y == 0) {
+                    lval_del(a);
+                    return lval_err("Division by Zero!");
+                }
+                x /= y;
+            break;
+        }
+    }
+
+    LASSERT(a, isfinite(x), "Float overflow!");
+    lval_del(a);
+    return lval_dbl(x);
+}
+
+lval* builtin_op(lenv* e, lval* a, int op) {
+    LASSERT(a, a->count > 0, "Function '%s' passed no arguments.", larith_names[op]);
+
+    int dbl = 0;
+    for (int i=0; i < a->count; i++) {
+        if (!lval_is_num(a->cell[i])) {
+            lval_del(a);
+            return lval_err("Cannot operate on non-number!");
+        }
+        if (a->cell[i]->type == LVAL_DBL) { dbl = 1; }
+    }
+    if (dbl) { return builtin_op_dbl(a, op); }
+
+    if (a->cell[0]->big) { return builtin_op_big(a, op, 1, lbig_copy(a->cell[0]->big)); }
+
+    // the args are reduced where they are, into a plain long that is only boxed at the end.
+    // they are all released along with a afterwards (they may well be shared, small nums always are).
+    // every step is checked for overflow, and the first one that would (or a big arg) stops the
+    // loop early at i, leaving the rest to builtin_op_big
+    lval** cell = a->cell;
+    int n = a->count;
+    long x = cell[0]->num;
+    long r;
+    int i = 1;
+
+    switch (op) {
+        case LARITH_ADD:
+            for (; i < n; i++) {
+                if (cell[i]->big || __builtin_add_overflow(x, cell[i]->num, &r)) { break; }
+                x = r;
+            }
+        break;
+
+        case LARITH_SUB:
+            // handle cases like "(- 5)" which should evaluate to "-5"
+            if (n == 1) {
+                if (x == LONG_MIN) { return builtin_op_big(a, op, 1, lbig_from_long(x)); }
+                x = -x;
+            }
+            for (; i < n; i++) {
+                if (cell[i]->big || __builtin_sub_overflow(x, cell[i]->num, &r)) { break; }
+                x = r;
+            }
+        break;
+
+        case LARITH_MUL:
+            for (; i < n; i++) {
+                if (cell[i]->big || __builtin_mul_overflow(x, cell[i]->num, &r)) { break; }
+                x = r;
+            }
+        break;
+
+        case LARITH_DIV:
+            for (; i < n; i++) {
+                if (cell[i]->big || (x == LONG_MIN && cell[i]->num == -1)) { break; }
+                if (cell[i]->num == 0) {
+                    lval_del(a);
+                    return lval_err("Division by Zero!");
+                }
+                x /= cell[i]->num;
+            }
+        break;
+    }
+
+    if (i < n) { return builtin_op_big(a, op, i, lbig_from_long(x)); }
+
+    lval_del(a);
+    return lval_num(x);
+}
+
+lval* builtin_add(lenv* e, lval* a) { return builtin_op(e, a, LARITH_ADD); }
+lval* builtin_sub(lenv* e, lval* a) { return builtin_op(e, a, LARITH_SUB); }
+lval* builtin_mul(lenv* e, lval* a) { return builtin_op(e, a, LARITH_MUL); }
+lval* builtin_div(lenv* e, lval* a) { return builtin_op(e, a, LARITH_DIV); }
+
+
+// -1, 0 or 1 as the Number x is less than, equal to or greater than d. this is exact: going
+// through double would round x first, making 2^53+1 equal to 2^53.0 and LONG_MAX equal to 2^63.0,
+// and lval_hash could never agree with that
+int lval_num_dbl_cmp(lval* x, double d) {
+    if (isnan(d)) { return 0; }
+    if (d >= 9223372036854775808.0 || d < -9223372036854775808.0) {
+        if (!x->big || isinf(d)) { return d > 0 ? -1 : 1; }
+        lbig* b = lbig_from_double(d);
+        int c = lbig_cmp(x->big, b);
+        lbig_del(b);
+        return c;
+    }
+    // a big number is always further from zero than any long, and d is within a long's range
+    if (x->big) { return x->big->neg ? -1 : 1; }
+    long t = (long)d;
+    if (x->num != t) { return (x->num > t) - (x->num < t); }
+    double frac = d - (double)t;
+    return (frac < 0) - (frac > 0);
+}
+
+// -1, 0 or 1 as x is less than, equal to or greater than y. two Floats are compared as doubles,
+// and only two bigs need actually comparing as numbers
+int lval_num_cmp(lval* x, lval* y) {
+    if (x->type == LVAL_DBL && y->type == LVAL_DBL) {
+        return (x->dbl > y->dbl) - (x->dbl < y->dbl);
+    }
+    if (x->type == LVAL_DBL) { return -lval_num_dbl_cmp(y, x->dbl); }
+    if (y->type == LVAL_DBL) { return lval_num_dbl_cmp(x, y->dbl); }
+    if (!x->big && !y->big) { return (x->num > y->num) - (x->num < y->num); }
+    if (!y->big) { return x->big->neg ? -1 : 1; }
+    if (!x->big) { return y->big->neg ? 1 : -1; }
+    return lbig_cmp(x->big, y->big);
+}
+
+lval* builtin_compare(lenv* e, lval* a, int op) {
+    LASSERT(a, a->count == 2, "Expected 2 operands, got %i", a->count);
+    
+    if (!lval_is_num(a->cell[0]) || !lval_is_num(a->cell[1])) {
+        lval_del(a);
+        return lval_err("Cannot operate on non-number!");
+    }
+
+    int c = lval_num_cmp(a->cell[0], a->cell[1]);
+
+    int result = 0;
+    switch (op) {
+        case LCMP_LT: result = c < 0; break;
+        case LCMP_GT: result = c > 0; break;
+        case LCMP_LE: result = c <= 0; break;
+        case LCMP_GE: result = c >= 0; break;
+    }
+
+    lval_del(a);
+    return lval_num(result);
+}
+
+/* Maps */
+// a hash table from any value to any value, compared with lval_eq. like vectors, maps are changed
+// in place and shared by reference. the entries are kept in insertion order (which is the order
+// map-keys and friends give them in) with an open-addressing index over them, like lenv's. a
+// deleted entry's key is set to NULL and left where it is, until the index next gets rebuilt
+// and the entries are compacted
+
+struct lmap {
+    int count; // live entries
+    int used;  // entries in keys/vals/hashes, deleted ones included
+    int cap;
+    lval** keys;
+    lval** vals;
+    unsigned* hashes;
+
+    // index slots hold (position in keys/vals)+1, 0 means empty. size is a power of 2
+    int index_size;
+    int* index;
+};
+
+int lmap_find(lmap* m, lval* k);
+lval* lmap_get(lmap* m, lval* k);
+
+// the Vectors and Maps that lval_print and lval_eq are in the middle of, further up the C stack.
+// vec-set! and map-put can make one hold itself, directly or through other values, and going
+// into it again would never finish
+typedef struct lpath {
+    lval** items;
+    int count;
+    int cap;
+} lpath;
+
+lpath lprint_path;
+lpath leq_path;     // pairs: x at even positions, y after it
+
+void lpath_push(lpath* p, lval* v) {
+    if (p->count == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 64;
+        p->items = realloc(p->items, sizeof(lval*) * p->cap);
+    }
+    p->items[p->count++] = v;
+}
+
+int lpath_has(lpath* p, lval* v) {
+    for (int i = 0; i < p->count; i++) {
+        if (p->items[i] == v) { return 1; }
+    }
+    return 0;
+}
+
+int lpath_has_pair(lpath* p, lval* x, lval* y) {
+    for (int i = 0; i < p->count; i += 2) {
+        if (p->items[i] == x && p->items[i+1] == y) { return 1; }
+    }
+    return 0;
+}
+
+int lval_eq(lval* x, lval* y);
+
+int lvec_eq(lval* x, lval* y) {
+    if (x->vlen != y->vlen) { return 0; }
+    for (int i = 0; i < x->vlen; i++) {
+        lval* a = lval_vec_get(x, i);
+        lval* b = lval_vec_get(y, i);
+        int eq = lval_eq(a, b);
+        lval_del(a); lval_del(b);
+        if (!eq) { return 0; }
+    }
+    return 1;
+}
+
+// the same keys, each with an equal value
+int lmap_eq(lval* x, lval* y) {
+    if (x->map->count != y->map->count) { return 0; }
+    for (int i = 0; i < x->map->used; i++) {
+        if (!x->map->keys[i]) { continue; }
+        lval* v = lmap_get(y->map, x->map->keys[i]);
+        if (!v || !lval_eq(x->map->vals[i], v)) { return 0; }
+    }
+    return 1;
+}
+
+int lval_eq(lval* x, lval* y) {
+    // a Number and a Float are equal if they are the same number
+    if (lval_is_num(x) && lval_is_num(y)) { return lval_num_cmp(x, y) == 0; }
+    if (x->type != y->type) { return 0; }
+
+    switch(x->type) {
+
+        case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
+        case LVAL_SYM: return (x->sym == y->sym);
+        case LVAL_STR: return x->slen == y->slen && memcmp(x->str, y->str, x->slen) == 0;
+        case LVAL_BUILDER: return x->blen == y->blen && memcmp(x->bbuf, y->bbuf, x->blen) == 0;
+
+        case LVAL_FUN:
+            if (x->builtin || y->builtin) {
+                return x->builtin == y->builtin;
+            } else {
+                return lval_eq(x->formals, y-> formals) && lval_eq(x->body, y->body);
+            }
+
+        case LVAL_QEXPR:
+        case LVAL_SEXPR:
+            if (x->count != y->count) { return 0; }
+            for (int i = 0; i < x->count; i++) {
+                if (!lval_eq(x->cell[i], y->cell[i])) { return 0; }
+            }
+        return 1;
+
+        case LVAL_VEC:
+        case LVAL_MAP: {
+            if (x == y) { return 1; }
+            // x and y are already being compared further up. if they differ, that is where it
+            // gets found out
+            if (lpath_has_pair(&leq_path, x, y)) { return 1; }
+            lpath_push(&leq_path, x);
+            lpath_push(&leq_path, y);
+            int eq = (x->type == LVAL_VEC) ? lvec_eq(x, y) : lmap_eq(x, y);
+            leq_path.count -= 2;
+            return eq;
+        }
+    }
+
+    return 0;
+}
+
+// a hash of v's structure which agrees with lval_eq: if lval_eq(x, y) then x and y hash the same.
+// that means a Float with an integral value hashes like the Number, and a big Number like the
+// Float it compares as
+unsigned lhash_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (unsigned)x;
+}
+
+unsigned lhash_bytes(char* s, int n) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < n; i++) { h = (h ^ (unsigned char)s[i]) * 16777619u; }
+    return h;
+}
+
+unsigned lhash_dbl(double d) {
+    if (d >= (double)LONG_MIN && d < (double)LONG_MAX && d == (double)(long)d) {
+        return lhash_mix((uint64_t)(long)d);
+    }
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return lhash_mix(bits);
+}
+
+// a Vector or Map inside another one only adds its type and size: it may be the one being hashed,
+// and equal ones still have the same of both
+unsigned lval_hash_in(lval* v, int nested) {
+    unsigned h = v->type * 31;
+    switch (v->type) {
+        case LVAL_NUM:
+            if (v->big) { return lhash_dbl(lbig_to_double(v->big)); }
+            return lhash_mix((uint64_t)v->num);
+        case LVAL_DBL: return lhash_dbl(v->dbl);
+        case LVAL_ERR: return lhash_bytes(v->err, strlen(v->err));
+        case LVAL_SYM: return lhash_mix((uintptr_t)v->sym);
+        case LVAL_STR: return lhash_bytes(v->str, v->slen);
+        case LVAL_BUILDER: return lhash_bytes(v->bbuf, v->blen);
+
+        case LVAL_FUN:
+            if (v->builtin) { return lhash_mix((uintptr_t)v->builtin); }
+            return lval_hash_in(v->formals, nested) * 31 + lval_hash_in(v->body, nested);
+
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            for (int i = 0; i < v->count; i++) { h = h * 31 + lval_hash_in(v->cell[i], nested); }
+        return h;
+
+        case LVAL_VEC:
+            if (nested) { return h * 31 + v->vlen; }
+            for (int i = 0; i < v->vlen; i++) {
+                lval* x = lval_vec_get(v, i);
+                h = h * 31 + lval_hash_in(x, 1);
+                lval_del(x);
+            }
+        return h;
+
+        // the order of the entries doesn't matter to lval_eq, so they are combined with +
+        case LVAL_MAP:
+            if (nested) { return h * 31 + v->map->count; }
+            for (int i = 0; i < v->map->used; i++) {
+                if (!v->map->keys[i]) { continue; }
+                h += lhash_mix(lval_hash_in(v->map->keys[i], 1) * 31ULL
+                    + lval_hash_in(v->map->vals[i], 1));
+            }
+        return h;
+    }
+    return h;
+}
+
+unsigned lval_hash(lval* v) {
+    return lval_hash_in(v, 0);
+}
+
+lmap* lmap_new(void) {
+    return lmem_calloc(1, sizeof(lmap));
+}
+
+void lmap_del(lmap* m) {
+    for (int i = 0; i < m->used; i++) {
+        if (m->keys[i]) {
+            lval_del(m->keys[i]);
+            lval_del(m->vals[i]);
+        }
+    }
+    lmem_free(m->keys, sizeof(lval*) * m->cap);
+    lmem_free(m->vals, sizeof(lval*) * m->cap);
+    lmem_free(m->hashes, sizeof(unsigned) * m->cap);
+    lmem_free(m->index, sizeof(int) * m->index_size);
+    lmem_free(m, sizeof(lmap));
+}
+
+// position of k in m's entries or -1
+int lmap_find(lmap* m, lval* k) {
+    if (!m->index_size) { return -1; }
+
+    unsigned h = lval_hash(k);
+    unsigned mask = m->index_size - 1;
+    for (unsigned s = h & mask; m->index[s]; s = (s + 1) & mask) {
+        int i = m->index[s] - 1;
+        if (m->keys[i] && m->hashes[i] == h && lval_eq(m->keys[i], k)) { return i; }
+    }
+    return -1;
+}
+
+lval* lmap_get(lmap* m, lval* k) {
+    int i = lmap_find(m, k);
+    return i >= 0 ? m->vals[i] : NULL;
+}
+
+void lmap_index_insert(lmap* m, int i) {
+    unsigned mask = m->index_size - 1;
+    unsigned s = m->hashes[i] & mask;
+    while (m->index[s]) { s = (s + 1) & mask; }
+    m->index[s] = i + 1;
+}
+
+// drop deleted entries and rebuild the index so that it has room for at least one more entry
+// while staying at most half full
+void lmap_rehash(lmap* m) {
+    int n = 0;
+    for (int i = 0; i < m->used; i++) {
+        if (!m->keys[i]) { continue; }
+        m->keys[n] = m->keys[i];
+        m->vals[n] = m->vals[i];
+        m->hashes[n] = m->hashes[i];
+        n++;
+    }
+    m->used = n;
+
+    int size = 8;
+    while (size < (n + 1) * 2) { size *= 2; }
+    lmem_free(m->index, sizeof(int) * m->index_size);
+    m->index_size = size;
+    m->index = lmem_calloc(size, sizeof(int));
+    for (int i = 0; i < n; i++) { lmap_index_insert(m, i); }
+}
+
+// takes ownership of k and v
+void lmap_put(lmap* m, lval* k, lval* v) {
+    int i = lmap_find(m, k);
+    if (i >= 0) {
+        lval_del(k);
+        lval_del(m->vals[i]);
+        m->vals[i] = v;
+        return;
+    }
+
+    if ((m->used + 1) * 2 > m->index_size) { lmap_rehash(m); }
+    if (m->used == m->cap) {
+        int cap = m->cap ? m->cap * 2 : 4;
+        m->keys = lmem_realloc(m->keys, sizeof(lval*) * m->cap, sizeof(lval*) * cap);
+        m->vals = lmem_realloc(m->vals, sizeof(lval*) * m->cap, sizeof(lval*) * cap);
+        m->hashes = lmem_realloc(m->hashes, sizeof(unsigned) * m->cap, sizeof(unsigned) * cap);
+        m->cap = cap;
+    }
+
+    i = m->used++;
+    m->keys[i] = k;
+    m->vals[i] = v;
+    m->hashes[i] = lval_hash(k);
+    m->count++;
+    lmap_index_insert(m, i);
+}
+
+// returns whether k was there
+int lmap_remove(lmap* m, lval* k) {
+    int i = lmap_find(m, k);
+    if (i < 0) { return 0; }
+
+    lval_del(m->keys[i]);
+    lval_del(m->vals[i]);
+    m->keys[i] = NULL;
+    m->vals[i] = NULL;
+    m->count--;
+    return 1;
+}
+
+lval* lval_map(void) {
+    lval* v = lval_alloc();
+    v->refs = 1;
+    v->type = LVAL_MAP;
+    lgc_young_add(v);
+    v->map = lmap_new();
+    return v;
+}
+
+lval* builtin_cmp(lenv* e, lval* a, int op) {
+    LASSERT_NUM(a, lcmp_names[op], 2);
+    int result = lval_eq(a->cell[0], a->cell[1]);
+    if (op == LCMP_NE) { result = !result; }
+    lval_del(a);
+    return lval_num(result);
+}
+
+lval* builtin_less(lenv* e, lval* a) { return builtin_compare(e, a, LCMP_LT); }
+lval* builtin_great(lenv* e, lval* a) { return builtin_compare(e, a, LCMP_GT); }
+lval* builtin_lessoreq(lenv* e, lval* a) { return builtin_compare(e, a, LCMP_LE); }
+lval* builtin_greatoreq(lenv* e, lval* a) { return builtin_compare(e, a, LCMP_GE); }
+lval* builtin_eq(lenv* e, lval* a) { return builtin_cmp(e, a, LCMP_EQ); }
+lval* builtin_neq(lenv* e, lval* a) { return builtin_cmp(e, a, LCMP_NE); }
+
+// math functions take a number, or a Q-Expression of numbers which they map over. the list is
+// gathered into a plain array of doubles first so that each function is one tight loop over
+// contiguous memory (the LMATH_KERNELs below), which the compiler can vectorize
+typedef void (*lmath_kernel)(double*, int);
+
+#define LMATH_KERNEL(name) \
+    void lmath_##name(double* x, int n) { for (int i = 0; i < n; i++) { x[i] = name(x[i]); } }
+
+LMATH_KERNEL(sqrt)
+LMATH_KERNEL(exp)
+LMATH_KERNEL(log)
+LMATH_KERNEL(sin)
+LMATH_KERNEL(cos)
+LMATH_KERNEL(tan)
+LMATH_KERNEL(floor)
+LMATH_KERNEL(ceil)
+
+lval* builtin_math(lenv* e, lval* a, char* func, lmath_kernel kernel) {
+    LASSERT_NUM(a, func, 1);
+
+    lval* v = a->cell[0];
+    if (lval_is_num(v)) {
+        double x = lval_to_double(v);
+        LASSERT(a, isfinite(x), "Number too big to convert to Float!");
+        kernel(&x, 1);
+        LASSERT(a, isfinite(x),
+            "Function '%s' has no finite Float result for its argument.", func);
+        lval_del(a);
+        return lval_dbl(x);
+    }
+
+    LASSERT(a, v->type == LVAL_QEXPR,
+        "Function '%s' passed incorrect type. Got %s, expected %s or %s.",
+        func, ltype_name(v->type), ltype_name(LVAL_DBL), ltype_name(LVAL_QEXPR));
+    for (int i = 0; i < v->count; i++) {
+        LASSERT(a, lval_is_num(v->cell[i]),
+            "Function '%s' passed a list containing %s, expected numbers.",
+            func, ltype_name(v->cell[i]->type));
+        LASSERT(a, isfinite(lval_to_double(v->cell[i])), "Number too big to convert to Float!");
+    }
+
+    int n = v->count;
+    double* xs = malloc(sizeof(double) * (n + 1));
+    for (int i = 0; i < n; i++) { xs[i] = lval_to_double(v->cell[i]); }
+    kernel(xs, n);
+
+    // sqrt of a negative, log of 0 and so on. checked afterwards, so the kernels stay simple loops
+    for (int i = 0; i < n; i++) {
+        if (!isfinite(xs[i])) {
+            free(xs);
+            lval_del(a);
+            return lval_err("Function '%s' has no finite Float result for its argument.", func);
+        }
+    }
+
+    lval* r = lval_qexpr();
+    lval_reserve(r, n);
+    for (int i = 0; i < n; i++) { r->cell[r->count++] = lval_dbl(xs[i]); }
+
+    free(xs);
+    lval_del(a);
+    return r;
+}
+
+lval* builtin_sqrt(lenv* e, lval* a) { return builtin_math(e, a, "sqrt", lmath_sqrt); }
+lval* builtin_exp(lenv* e, lval* a) { return builtin_math(e, a, "exp", lmath_exp); }
+lval* builtin_log(lenv* e, lval* a) { return builtin_math(e, a, "log", lmath_log); }
+lval* builtin_sin(lenv* e, lval* a) { return builtin_math(e, a, "sin", lmath_sin); }
+lval* builtin_cos(lenv* e, lval* a) { return builtin_math(e, a, "cos", lmath_cos); }
+lval* builtin_tan(lenv* e, lval* a) { return builtin_math(e, a, "tan", lmath_tan); }
+lval* builtin_floor(lenv* e, lval* a) { return builtin_math(e, a, "floor", lmath_floor); }
+lval* builtin_ceil(lenv* e, lval* a) { return builtin_math(e, a, "ceil", lmath_ceil); }
+
+#define LASSERT_INDEX(args, func, index, max) \
+    LASSERT_TYPE(args, func, index, LVAL_NUM); \
+    LASSERT(args, !args->cell[index]->big && args->cell[index]->num >= 0 && args->cell[index]->num <= (max), \
+    "Function '%s' passed index out of range for argument %i. Expected 0 to %i.", func, index, (max))
+
+lval* lmem_refused(lval* err);
+
+// a new vector holding the elements of l, unboxed if they allow it, or an error if there isn't
+// the memory for it
+lval* lval_vec_from(lval* l) {
+    int kind = l->count ? lvec_kind(l->cell[0]) : LVEC_INT;
+    for (int i = 1; i < l->count && kind != LVEC_ANY; i++) {
+        if (lvec_kind(l->cell[i]) != kind) { kind = LVEC_ANY; }
+    }
+
+    lval* v = lval_vec(kind, l->count);
+    if (!v) {
+        return lmem_refused(lval_err("Couldn't get the memory for a Vector of %i elements.",
+            l->count));
+    }
+    for (int i = 0; i < l->count; i++) {
+        switch (kind) {
+            case LVEC_INT: v->vints[i] = l->cell[i]->num; break;
+            case LVEC_DBL: v->vdbls[i] = l->cell[i]->dbl; break;
+            case LVEC_ANY: v->vcells[i] = lval_copy(l->cell[i]); break;
+        }
+    }
+    return v;
+}
+
+lval* builtin_vec(lenv* e, lval* a) {
+    lval* v = lval_vec_from(a);
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_list_to_vec(lenv* e, lval* a) {
+    LASSERT_NUM(a, "list->vec", 1);
+    LASSERT_TYPE(a, "list->vec", 0, LVAL_QEXPR);
+
+    lval* v = lval_vec_from(a->cell[0]);
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_vec_to_list(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec->list", 1);
+    LASSERT_TYPE(a, "vec->list", 0, LVAL_VEC);
+
+    lval* v = a->cell[0];
+    lval* l = lval_qexpr();
+    lval_reserve(l, v->vlen);
+    for (int i = 0; i < v->vlen; i++) { l->cell[l->count++] = lval_vec_get(v, i); }
+    lval_del(a);
+    return l;
+}
+
+// (vec-make n x) is a vector of n x's
+lval* builtin_vec_make(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec-make", 2);
+    LASSERT_INDEX(a, "vec-make", 0, INT_MAX - 1);
+    // whatever they are stored as the elements are all a word (see lvec_bytes)
+    LASSERT(a, (size_t)a->cell[0]->num < SIZE_MAX / sizeof(long),
+        "Function 'vec-make' would make a vector that is too long.");
+
+    int n = a->cell[0]->num;
+    lval* x = a->cell[1];
+    lval* v = lval_vec(lvec_kind(x), n);
+    if (!v) {
+        lval_del(a);
+        return lmem_refused(lval_err(
+            "Function 'vec-make' couldn't get the memory for %i elements.", n));
+    }
+    for (int i = 0; i < n; i++) {
+        switch (v->vkind) {
+            case LVEC_INT: v->vints[i] = x->num; break;
+            case LVEC_DBL: v->vdbls[i] = x->dbl; break;
+            case LVEC_ANY: v->vcells[i] = lval_copy(x); break;
+        }
+    }
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_vec_len(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec-len", 1);
+    LASSERT_TYPE(a, "vec-len", 0, LVAL_VEC);
+
+    lval* n = lval_num(a->cell[0]->vlen);
+    lval_del(a);
+    return n;
+}
+
+lval* builtin_vec_ref(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec-ref", 2);
+    LASSERT_TYPE(a, "vec-ref", 0, LVAL_VEC);
+    LASSERT_INDEX(a, "vec-ref", 1, a->cell[0]->vlen - 1);
+
+    lval* x = lval_vec_get(a->cell[0], a->cell[1]->num);
+    lval_del(a);
+    return x;
+}
+
+lval* builtin_vec_set(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec-set!", 3);
+    LASSERT_TYPE(a, "vec-set!", 0, LVAL_VEC);
+    LASSERT_INDEX(a, "vec-set!", 1, a->cell[0]->vlen - 1);
+
+    lval_vec_put(a->cell[0], a->cell[1]->num, lval_copy(a->cell[2]));
+    lval_del(a);
+    return lval_sexpr();
+}
+
+// (vec-slice v start end) is a new vector of v's elements from start up to (not including) end
+lval* builtin_vec_slice(lenv* e, lval* a) {
+    LASSERT_NUM(a, "vec-slice", 3);
+    LASSERT_TYPE(a, "vec-slice", 0, LVAL_VEC);
+    LASSERT_INDEX(a, "vec-slice", 1, a->cell[0]->vlen);
+    LASSERT_INDEX(a, "vec-slice", 2, a->cell[0]->vlen);
+
+    lval* v = a->cell[0];
+    int start = a->cell[1]->num;
+    int end = a->cell[2]->num;
+    LASSERT(a, start <= end, "Function 'vec-slice' passed start %i after end %i.", start, end);
+
+    lval* s = lval_vec(v->vkind, end - start);
+    if (!s) {
+        lval_del(a);
+        return lmem_refused(lval_err(
+            "Function 'vec-slice' couldn't get the memory for %i elements.", end - start));
+    }
+    switch (v->vkind) {
+        case LVEC_INT: memcpy(s->vints, v->vints + start, sizeof(long) * s->vlen); break;
+        case LVEC_DBL: memcpy(s->vdbls, v->vdbls + start, sizeof(double) * s->vlen); break;
+        case LVEC_ANY:
+            for (int i = 0; i < s->vlen; i++) { s->vcells[i] = lval_copy(v->vcells[start + i]); }
+        break;
+    }
+    lval_del(a);
+    return s;
+}
+
+// (vec-fill! v x) sets every element of v to x, (vec-fill! v x start end) just those in the range
+lval* builtin_vec_fill(lenv* e, lval* a) {
+    LASSERT(a, a->count == 2 || a->count == 4,
+        "Function 'vec-fill!' passed incorrect num of args. Got %i, expected 2 or 4.", a->count);
+    LASSERT_TYPE(a, "vec-fill!", 0, LVAL_VEC);
+
+    lval* v = a->cell[0];
+    lval* x = a->cell[1];
+    int start = 0;
+    int end = v->vlen;
+    if (a->count == 4) {
+        LASSERT_INDEX(a, "vec-fill!", 2, v->vlen);
+        LASSERT_INDEX(a, "vec-fill!", 3, v->vlen);
+        start = a->cell[2]->num;
+        end = a->cell[3]->num;
+    }
+
+    if (v->vkind != LVEC_ANY && lvec_kind(x) != v->vkind) { lval_vec_box(v); }
+    switch (v->vkind) {
+        case LVEC_INT: for (int i = start; i < end; i++) { v->vints[i] = x->num; } break;
+        case LVEC_DBL: for (int i = start; i < end; i++) { v->vdbls[i] = x->dbl; } break;
+        case LVEC_ANY:
+            for (int i = start; i < end; i++) {
+                lval_del(v->vcells[i]);
+                v->vcells[i] = lval_copy(x);
+            }
+        break;
+    }
+    lval_del(a);
+    return lval_sexpr();
+}
+
+// (map-from {{k1 v1} {k2 v2} ...}) is a new map holding those entries, later ones win
+lval* builtin_map_from(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-from", 1);
+    LASSERT_TYPE(a, "map-from", 0, LVAL_QEXPR);
+
+    lval* l = a->cell[0];
+    for (int i = 0; i < l->count; i++) {
+        LASSERT(a, l->cell[i]->type == LVAL_QEXPR && l->cell[i]->count == 2,
+            "Function 'map-from' passed an entry that isn't a {key value} pair.");
+    }
+
+    lval* m = lval_map();
+    for (int i = 0; i < l->count; i++) {
+        lval* p = l->cell[i];
+        lmap_put(m->map, lval_copy(p->cell[0]), lval_copy(p->cell[1]));
+    }
+    lval_del(a);
+    return m;
+}
+
+// (map-get m k) is the value for k, or an error if there isn't one. (map-get m k d) gives d instead
+lval* builtin_map_get(lenv* e, lval* a) {
+    LASSERT(a, a->count == 2 || a->count == 3,
+        "Function 'map-get' passed incorrect num of args. Got %i, expected 2 or 3.", a->count);
+    LASSERT_TYPE(a, "map-get", 0, LVAL_MAP);
+
+    lval* v = lmap_get(a->cell[0]->map, a->cell[1]);
+    if (v) {
+        v = lval_copy(v);
+    } else {
+        LASSERT(a, a->count == 3, "Function 'map-get' passed a key that isn't in the map.");
+        v = lval_copy(a->cell[2]);
+    }
+    lval_del(a);
+    return v;
+}
+
+lval* builtin_map_put(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-put", 3);
+    LASSERT_TYPE(a, "map-put", 0, LVAL_MAP);
+
+    lmap_put(a->cell[0]->map, lval_copy(a->cell[1]), lval_copy(a->cell[2]));
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_map_del(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-del", 2);
+    LASSERT_TYPE(a, "map-del", 0, LVAL_MAP);
+
+    lmap_remove(a->cell[0]->map, a->cell[1]);
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_map_has(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-has", 2);
+    LASSERT_TYPE(a, "map-has", 0, LVAL_MAP);
+
+    lval* r = lval_num(lmap_find(a->cell[0]->map, a->cell[1]) >= 0);
+    lval_del(a);
+    return r;
+}
+
+lval* builtin_map_len(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-len", 1);
+    LASSERT_TYPE(a, "map-len", 0, LVAL_MAP);
+
+    lval* r = lval_num(a->cell[0]->map->count);
+    lval_del(a);
+    return r;
+}
+
+// map-keys, map-vals and map-items list the entries in the order they were first put in
+enum { LMAP_KEYS, LMAP_VALS, LMAP_ITEMS };
+
+lval* builtin_map_list(lenv* e, lval* a, char* func, int what) {
+    LASSERT_NUM(a, func, 1);
+    LASSERT_TYPE(a, func, 0, LVAL_MAP);
+
+    lmap* m = a->cell[0]->map;
+    lval* l = lval_qexpr();
+    lval_reserve(l, m->count);
+    for (int i = 0; i < m->used; i++) {
+        if (!m->keys[i]) { continue; }
+        lval* x;
+        switch (what) {
+            case LMAP_KEYS: x = lval_copy(m->keys[i]); break;
+            case LMAP_VALS: x = lval_copy(m->vals[i]); break;
+            default:
+                x = lval_add(lval_add(lval_qexpr(), lval_copy(m->keys[i])), lval_copy(m->vals[i]));
+            break;
+        }
+        l->cell[l->count++] = x;
+    }
+    lval_del(a);
+    return l;
+}
+
+lval* builtin_map_keys(lenv* e, lval* a) { return builtin_map_list(e, a, "map-keys", LMAP_KEYS); }
+lval* builtin_map_vals(lenv* e, lval* a) { return builtin_map_list(e, a, "map-vals", LMAP_VALS); }
+lval* builtin_map_items(lenv* e, lval* a) { return builtin_map_list(e, a, "map-items", LMAP_ITEMS); }
+
+lval* lval_call(lenv* e, lval* f, lval* a);
+
+// (map-each m f) calls (f k v) for every entry, stopping at the first error. f may change m,
+// entries it puts in are visited too and ones it deletes are skipped
+lval* builtin_map_each(lenv* e, lval* a) {
+    LASSERT_NUM(a, "map-each", 2);
+    LASSERT_TYPE(a, "map-each", 0, LVAL_MAP);
+    LASSERT_TYPE(a, "map-each", 1, LVAL_FUN);
+
+    lmap* m = a->cell[0]->map;
+    lval* f = a->cell[1];
+    for (int i = 0; i < m->used; i++) {
+        if (!m->keys[i]) { continue; }
+        lval* args = lval_add(lval_add(lval_sexpr(), lval_copy(m->keys[i])), lval_copy(m->vals[i]));
+        lval* r = lval_call(e, f, args);
+        if (r->type == LVAL_ERR) {
+            lval_del(a);
+            return r;
+        }
+        lval_del(r);
+    }
+    lval_del(a);
+    return lval_sexpr();
+}
+
+// formals are bound in order into the frame of a call, so a reference to one of them can be
+// looked up by its position (skipping '&') instead of by name. this only leaves hints on the
+// symbols, which lenv_get checks before trusting, so it's fine for body to be shared
+void lval_resolve(lval* x, lval* formals) {
+    if (x->type == LVAL_SYM) {
+        int slot = 0;
+        for (int i = 0; i < formals->count; i++) {
+            if (formals->cell[i]->sym == lsym_amp) { continue; }
+            if (formals->cell[i]->sym == x->sym) {
+                x->slot = slot;
+                return;
+            }
+            slot++;
+        }
+    }
+
+    if (x->type == LVAL_SEXPR || x->type == LVAL_QEXPR) {
+        for (int i = 0; i < x->count; i++) {
+            lval_resolve(x->cell[i], formals);
+        }
+    }
+}
+
+void lval_fold_body(lval* body, lval* formals);
+
+lval* builtin_lambda(lenv* e, lval* a) {
+    // check 2 args, both Q-Expressions
+    LASSERT_NUM(a, "\\", 2);
+    LASSERT_TYPE(a, "\\", 0, LVAL_QEXPR);
+    LASSERT_TYPE(a, "\\", 1, LVAL_QEXPR);
+
+    // check that the first Q-Expression contains only symbols
+    for (int i = 0; i < a->cell[0]->count; i++) {
+        LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
+        "Cannot define non-symbol. Got %s, expected %s.",
+        ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+    }
+
+    lval* formals = lval_pop(a, 0);
+    lval* body = lval_pop(a, 0);
+    lval_del(a);
+
+    lval_resolve(body, formals);
+    lval_fold_body(body, formals);
+    return lval_lambda(formals, body);
+}
+
+lval *builtin_var(lenv* e, lval* a, char* func) {
+    LASSERT_TYPE(a, func, 0, LVAL_QEXPR);
+
+    lval* syms = a->cell[0];
+    for (int i = 0; i < syms->count; i++) {
+        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
+        "Function %s cannot define non-symbol. Got %s, expected %s",
+        func, ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+    }
+
+    LASSERT(a, (syms->count == a->count-1), 
+    "Function '%s' passed too many arguments for symbols. Got %i, expected %i",
+    func, syms->count, a->count-1);
+
+    // if 'def' define globally, if 'put' define locally
+    for (int i = 0; i < syms->count; i++) {
+        if (strcmp(func, "def") == 0) {
+            lenv_def(e, syms->cell[i], a->cell[i+1]);
+        }
+
+        if (strcmp(func, "=") == 0) {
+            lenv_put(e, syms->cell[i], a->cell[i+1]);
+        }
+    }
+
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_def(lenv* e, lval* a) { return builtin_var(e, a, "def"); }
+lval* builtin_put(lenv* e, lval* a) { return builtin_var(e, a, "="); }
+
+/* Special forms */
+// if, and, or, cond, let, def, = and the loops get to see their args before they are evaluated,
+// so they only evaluate what they need: the branch not taken, the rest of an and/or once the
+// answer is known and the clauses after the one that matches are never touched, and a loop can
+// evaluate its test and body over and over. both evaluators spot them
+// by their head and hand the unevaluated args to lform_run. called as ordinary functions (say
+// through unpack) they get values instead, which evaluate to themselves, so lform_run works for
+// those just the same
+
+lval* builtin_if(lenv* e, lval* a);
+lval* builtin_and(lenv* e, lval* a);
+lval* builtin_or(lenv* e, lval* a);
+lval* builtin_cond(lenv* e, lval* a);
+lval* builtin_let(lenv* e, lval* a);
+lval* builtin_while(lenv* e, lval* a);
+lval* builtin_dotimes(lenv* e, lval* a);
+lval* builtin_for_each(lenv* e, lval* a);
+lval* lval_folded(lval* v);
+lval* lval_run(lenv* e, lval* l);
+
+// whether list l, whose head evaluated to f, is a special form. def and = only need to be one
+// for (def x 1), otherwise they are left as ordinary calls, which the VM runs inline
+int lform_is(lval* f, lval* l) {
+    if (f->type != LVAL_FUN || !f->builtin) { return 0; }
+    lbuiltin b = f->builtin;
+    if (b == builtin_def || b == builtin_put) { return l->cell[1]->type == LVAL_SYM; }
+    return b == builtin_if || b == builtin_and || b == builtin_or || b == builtin_cond
+        || b == builtin_let || b == builtin_while || b == builtin_dotimes || b == builtin_for_each;
+}
+
+// takes over x, the value of a condition. NULL if it is a Number (*truth says which way it
+// went), otherwise an error
+lval* lform_test(lval* x, char* func, int* truth) {
+    if (x->type == LVAL_ERR) { return x; }
+    if (x->type != LVAL_NUM) {
+        lval* err = lval_err("Function '%s' passed incorrect type. Got %s, expected %s.",
+            func, ltype_name(x->type), ltype_name(LVAL_NUM));
+        lval_del(x);
+        return err;
+    }
+    *truth = (x->num || x->big);
+    lval_del(x);
+    return NULL;
+}
+
+// an if branch or a let body: x has to give a Q-Expression, whose contents are what is left
+// to evaluate
+lval* lform_body(lenv* e, lval* x, char* func, lval** next) {
+    x = lval_eval(e, lval_copy(x));
+    if (x->type == LVAL_QEXPR) {
+        *next = x;
+        return NULL;
+    }
+    if (x->type == LVAL_ERR) { return x; }
+
+    lval* err = lval_err("Function '%s' passed incorrect type. Got %s, expected %s.",
+        func, ltype_name(x->type), ltype_name(LVAL_QEXPR));
+    lval_del(x);
+    return err;
+}
+
+// the last arg of and/or or the expression of a cond clause, which is evaluated as it is
+lval* lform_expr(lenv* e, lval* x, lval** next) {
+    if (x->type == LVAL_SEXPR && !lval_folded(x)) {
+        *next = lval_copy(x);
+        return NULL;
+    }
+    return lval_eval(e, lval_copy(x));
+}
+
+// one time round a loop: the contents of body are evaluated in e, the value thrown away. NULL
+// unless that gave an error
+lval* lform_step(lenv* e, lval* body) {
+    lval* x = lval_run(e, lval_copy(body));
+    if (x->type == LVAL_ERR) { return x; }
+    lval_del(x);
+    return NULL;
+}
+
+// runs special form `form` on the n args. returns the value, or NULL with *next set to a list
+// (possibly shared) whose contents are left to evaluate in tail position, in *e. let changes *e
+// to a new frame, which the caller then has to delete
+lval* lform_run(lenv** env, lbuiltin form, lval** args, int n, lval** next) {
+    lenv* e = *env;
+    *next = NULL;
+
+    if (form == builtin_if) {
+        if (n != 3) {
+            return lval_err("Function '%s' passed incorrect num of args. Got %i, expected %i.",
+                "if", n, 3);
+        }
+
+        int truth;
+        lval* err = lform_test(lval_eval(e, lval_copy(args[0])), "if", &truth);
+        if (err) { return err; }
+        return lform_body(e, args[truth ? 1 : 2], "if", next);
+    }
+
+    // and stops at the first false arg, or at the first true one. the last arg is the answer
+    // if it gets that far
+    if (form == builtin_and || form == builtin_or) {
+        int stop = (form == builtin_or);
+        char* func = stop ? "or" : "and";
+        if (n == 0) { return lval_num(!stop); }
+
+        for (int i = 0; i < n-1; i++) {
+            lval* x = lval_eval(e, lval_copy(args[i]));
+            if (x->type == LVAL_NUM && (x->num || x->big) == stop) { return x; }
+
+            int truth;
+            lval* err = lform_test(x, func, &truth);
+            if (err) { return err; }
+        }
+        return lform_expr(e, args[n-1], next);
+    }
+
+    // each clause is {test expression}, the first whose test is true gives the value
+    if (form == builtin_cond) {
+        for (int i = 0; i < n; i++) {
+            lval* c = lval_eval(e, lval_copy(args[i]));
+            if (c->type == LVAL_ERR) { return c; }
+            if (c->type != LVAL_QEXPR || c->count != 2) {
+                lval_del(c);
+                return lval_err("Function 'cond' passed an invalid clause for argument %i. "
+                    "Expected {test expression}.", i);
+            }
+
+            int truth;
+            lval* err = lform_test(lval_eval(e, lval_copy(c->cell[0])), "cond", &truth);
+            if (err) { lval_del(c); return err; }
+
+            if (truth) {
+                lval* r = lform_expr(e, c->cell[1], next);
+                lval_del(c);
+                return r;
+            }
+            lval_del(c);
+        }
+        return lval_sexpr();
+    }
+
+    // let {{x 1} {y (+ x 1)}} {body}: each value sees the ones bound before it
+    if (form == builtin_let) {
+        if (n != 2) {
+            return lval_err("Function '%s' passed incorrect num of args. Got %i, expected %i.",
+                "let", n, 2);
+        }
+
+        lval* b = lval_eval(e, lval_copy(args[0]));
+        if (b->type == LVAL_ERR) { return b; }
+        if (b->type != LVAL_QEXPR) {
+            lval* err = lval_err("Function '%s' passed incorrect type. Got %s, expected %s.",
+                "let", ltype_name(b->type), ltype_name(LVAL_QEXPR));
+            lval_del(b);
+            return err;
+        }
+        for (int i = 0; i < b->count; i++) {
+            lval* x = b->cell[i];
+            if (x->type != LVAL_QEXPR || x->count != 2 || x->cell[0]->type != LVAL_SYM) {
+                lval_del(b);
+                return lval_err("Function 'let' passed an invalid binding at %i. "
+                    "Expected {symbol value}.", i);
+            }
+        }
+
+        lenv* frame = lenv_frame(b->count);
+        frame->parent = e;
+        for (int i = 0; i < b->count; i++) {
+            lval* x = lval_eval(frame, lval_copy(b->cell[i]->cell[1]));
+            if (x->type == LVAL_ERR) {
+                lenv_del(frame);
+                lval_del(b);
+                return x;
+            }
+            lenv_bind_sym(frame, b->cell[i]->cell[0]->sym, x);
+        }
+        lval_del(b);
+
+        lval* err = lform_body(frame, args[1], "let", next);
+        if (err) {
+            lenv_del(frame);
+            return err;
+        }
+        *env = frame;
+        return NULL;
+    }
+
+    // while (test) {body}. the body runs in this env, so = in it changes the variables we see
+    if (form == builtin_while) {
+        if (n != 2) {
+            return lval_err("Function '%s' passed incorrect num of args. Got %i, expected %i.",
+                "while", n, 2);
+        }
+
+        lval* body;
+        lval* err = lform_body(e, args[1], "while", &body);
+        if (err) { return err; }
+
+        while (1) {
+            int truth;
+            err = lform_test(lval_eval(e, lval_copy(args[0])), "while", &truth);
+            if (!err && truth) { err = lform_step(e, body); }
+            if (err || !truth) { break; }
+        }
+        lval_del(body);
+        return err ? err : lval_sexpr();
+    }
+
+    // dotimes {i n} {body} counts i from 0 to n-1, for-each {x l} {body} takes x from each
+    // element of a Q-Expression or Vector. the variable lives in one frame that every time round
+    // reuses
+    if (form == builtin_dotimes || form == builtin_for_each) {
+        int times = (form == builtin_dotimes);
+        char* func = times ? "dotimes" : "for-each";
+        if (n != 2) {
+            return lval_err("Function '%s' passed incorrect num of args. Got %i, expected %i.",
+                func, n, 2);
+        }
+
+        lval* spec = lval_eval(e, lval_copy(args[0]));
+        if (spec->type == LVAL_ERR) { return spec; }
+        if (spec->type != LVAL_QEXPR || spec->count != 2 || spec->cell[0]->type != LVAL_SYM) {
+            lval_del(spec);
+            return lval_err("Function '%s' passed an invalid loop. Expected {symbol %s}.",
+                func, times ? "count" : "list");
+        }
+
+        lval* over = lval_eval(e, lval_copy(spec->cell[1]));
+        lval* err = NULL;
+        if (over->type == LVAL_ERR) {
+            err = lval_copy(over);
+        } else if (times ? (over->type != LVAL_NUM || over->big)
+                         : (over->type != LVAL_QEXPR && over->type != LVAL_VEC)) {
+            err = lval_err("Function '%s' passed incorrect type. Got %s, expected %s.",
+                func, ltype_name(over->type), times ? "Number" : "Q-Expression or Vector");
+        }
+
+        lval* body = NULL;
+        if (!err) { err = lform_body(e, args[1], func, &body); }
+
+        if (!err) {
+            long count = times ? over->num : (over->type == LVAL_VEC ? over->vlen : over->count);
+            lenv* frame = lenv_frame(1);
+            frame->parent = e;
+
+            for (long i = 0; i < count && !err; i++) {
+                lval* x;
+                if (times) { x = lval_num(i); }
+                else if (over->type == LVAL_VEC) { x = lval_vec_get(over, i); }
+                else { x = lval_copy(over->cell[i]); }
+
+                lenv_bind_sym(frame, spec->cell[0]->sym, x);
+                err = lform_step(frame, body);
+            }
+            lenv_del(frame);
+            lval_del(body);
+        }
+
+        lval_del(over);
+        lval_del(spec);
+        return err ? err : lval_sexpr();
+    }
+
+    // def and =: (def x 1) names x itself, anything else is evaluated as usual
+    lval* a = lval_sexpr();
+    for (int i = 0; i < n; i++) {
+        lval* x;
+        if (i == 0 && n == 2 && args[0]->type == LVAL_SYM) {
+            x = lval_add(lval_qexpr(), lval_copy(args[0]));
+        } else {
+            x = lval_eval(e, lval_copy(args[i]));
+        }
+
+        if (x->type == LVAL_ERR) {
+            lval_del(a);
+            return x;
+        }
+        lval_add(a, x);
+    }
+    return form(e, a);
+}
+
+// a special form called as an ordinary function
+lval* lform_call(lenv* e, lbuiltin form, lval* a) {
+    lenv* env = e;
+    lval* next;
+    lval* r = lform_run(&env, form, a->cell, a->count, &next);
+    lval_del(a);
+    if (!next) { return r; }
+
+    r = lval_run(env, next);
+    if (env != e) { lenv_del(env); }
+    return r;
+}
+
+lval* builtin_if(lenv* e, lval* a) { return lform_call(e, builtin_if, a); }
+lval* builtin_and(lenv* e, lval* a) { return lform_call(e, builtin_and, a); }
+lval* builtin_or(lenv* e, lval* a) { return lform_call(e, builtin_or, a); }
+lval* builtin_cond(lenv* e, lval* a) { return lform_call(e, builtin_cond, a); }
+lval* builtin_let(lenv* e, lval* a) { return lform_call(e, builtin_let, a); }
+lval* builtin_while(lenv* e, lval* a) { return lform_call(e, builtin_while, a); }
+lval* builtin_dotimes(lenv* e, lval* a) { return lform_call(e, builtin_dotimes, a); }
+lval* builtin_for_each(lenv* e, lval* a) { return lform_call(e, builtin_for_each, a); }
+
+// load and read other files
+lval* lval_eval_top(lenv* e, lval* v);
+lval* builtin_load(lenv* e, lval* a) {
+  LASSERT_NUM(a, "load", 1);
+  LASSERT_TYPE(a, "load", 0, LVAL_STR);
+
+  mpc_result_t r;
+  if (mpc_parse_contents(a->cell[0]->str, Lispy, &r)) {
+
+    lval* expr = lval_read(r.output);
+    mpc_ast_delete(r.output);
+
+    // deal with each new expr
+    while (expr->count) {
+      lval* x = lval_eval_top(e, lval_pop(expr, 0));
+      if (x->type == LVAL_ERR) { lval_println(x); }
+      lval_del(x);
+      larena_reset();
+      // loaded from inside an evaluation that went over its quota, the rest would be too
+      if (lmem_tripped && lmem_depth) { break; }
+    }
+
+    lval_del(expr);
+    lval_del(a);
+
+    return lval_sexpr();
+
+  } else {
+    char* err_msg = mpc_err_string(r.error);
+    mpc_err_delete(r.error);
+
+    lval* err = lval_err("Could not load Library %s", err_msg);
+    free(err_msg);
+    lval_del(a);
+
+    return err;
+  }
+}
+
+lval* builtin_print(lenv* e, lval* a) {
+  for (int i = 0; i < a->count; i++) {
+    lval_print(a->cell[i]); putchar(' ');
+  }
+
+  putchar('\n');
+  lval_del(a);
+
+  return lval_sexpr();
+}
+
+lval* builtin_error(lenv* e, lval* a) {
+  LASSERT_NUM(a, "error", 1);
+  LASSERT_TYPE(a, "error", 0, LVAL_STR);
+  
+  lval* err = lval_err(a->cell[0]->str);
+  
+  lval_del(a);
+  return err;
+}
+
+lval* builtin_str_len(lenv* e, lval* a) {
+    LASSERT_NUM(a, "str-len", 1);
+    LASSERT_TYPE(a, "str-len", 0, LVAL_STR);
+
+    lval* n = lval_num(a->cell[0]->slen);
+    lval_del(a);
+    return n;
+}
+
+// (str-concat s1 s2 ...) measures everything first and copies each string once
+lval* builtin_str_concat(lenv* e, lval* a) {
+    long n = 0;
+    for (int i = 0; i < a->count; i++) {
+        LASSERT_TYPE(a, "str-concat", i, LVAL_STR);
+        n += a->cell[i]->slen;
+    }
+    LASSERT(a, n < INT_MAX, "Function 'str-concat' would make a string that is too long.");
+
+    lval* s = lval_str_new(n);
+    char* p = s->str;
+    for (int i = 0; i < a->count; i++) {
+        memcpy(p, a->cell[i]->str, a->cell[i]->slen);
+        p += a->cell[i]->slen;
+    }
+    lval_del(a);
+    return s;
+}
+
+// (substr s start end) is the part of s from start up to (not including) end
+lval* builtin_substr(lenv* e, lval* a) {
+    LASSERT_NUM(a, "substr", 3);
+    LASSERT_TYPE(a, "substr", 0, LVAL_STR);
+    LASSERT_INDEX(a, "substr", 1, a->cell[0]->slen);
+    LASSERT_INDEX(a, "substr", 2, a->cell[0]->slen);
+
+    int start = a->cell[1]->num;
+    int end = a->cell[2]->num;
+    LASSERT(a, start <= end, "Function 'substr' passed start %i after end %i.", start, end);
+
+    lval* s = lval_str_n(a->cell[0]->str + start, end - start);
+    lval_del(a);
+    return s;
+}
+
+// position of the first n[0..nn) in h[from..hn), or -1. this is Boyer-Moore-Horspool: the last
+// char of the needle is compared first, and on a mismatch the search skips ahead by however far
+// the char of h under the end of the needle allows
+int lstr_find(char* h, int hn, char* n, int nn, int from) {
+    if (nn > hn - from) { return -1; }
+    if (nn == 0) { return from; }
+    if (nn == 1) {
+        char* p = memchr(h + from, n[0], hn - from);
+        return p ? p - h : -1;
+    }
+
+    int skip[256];
+    for (int c = 0; c < 256; c++) { skip[c] = nn; }
+    for (int i = 0; i < nn - 1; i++) { skip[(unsigned char)n[i]] = nn - 1 - i; }
+
+    unsigned char last = n[nn-1];
+    for (int i = from; i <= hn - nn; ) {
+        unsigned char c = h[i + nn - 1];
+        if (c == last && memcmp(h + i, n, nn - 1) == 0) { return i; }
+        i += skip[c];
+    }
+    return -1;
+}
+
+// (str-find s needle) is where needle first appears in s, or -1
+lval* builtin_str_find(lenv* e, lval* a) {
+    LASSERT_NUM(a, "str-find", 2);
+    LASSERT_TYPE(a, "str-find", 0, LVAL_STR);
+    LASSERT_TYPE(a, "str-find", 1, LVAL_STR);
+
+    lval* s = a->cell[0];
+    lval* n = a->cell[1];
+    lval* r = lval_num(lstr_find(s->str, s->slen, n->str, n->slen, 0));
+    lval_del(a);
+    return r;
+}
+
+// (str-split s sep) is a list of the pieces of s between each sep. an empty sep splits s into
+// its single chars
+lval* builtin_str_split(lenv* e, lval* a) {
+    LASSERT_NUM(a, "str-split", 2);
+    LASSERT_TYPE(a, "str-split", 0, LVAL_STR);
+    LASSERT_TYPE(a, "str-split", 1, LVAL_STR);
+
+    lval* s = a->cell[0];
+    lval* sep = a->cell[1];
+    lval* l = lval_qexpr();
+
+    if (sep->slen == 0) {
+        lval_reserve(l, s->slen);
+        for (int i = 0; i < s->slen; i++) { l->cell[l->count++] = lval_str_n(s->str + i, 1); }
+        lval_del(a);
+        return l;
+    }
+
+    int from = 0;
+    while (1) {
+        int i = lstr_find(s->str, s->slen, sep->str, sep->slen, from);
+        int end = i >= 0 ? i : s->slen;
+        l = lval_add(l, lval_str_n(s->str + from, end - from));
+        if (i < 0) { break; }
+        from = i + sep->slen;
+    }
+    lval_del(a);
+    return l;
+}
+
+// appends the text of the args from i on to builder b: Strings and other Builders as they are,
+// Numbers and Floats as they would be printed
+lval* lval_builder_add(lval* b, lval* a, char* func, int first) {
+    for (int i = first; i < a->count; i++) {
+        lval* x = a->cell[i];
+        LASSERT(a, x->type == LVAL_STR || x->type == LVAL_BUILDER || lval_is_num(x),
+            "Function '%s' passed %s for argument %i, expected a String, Builder or number.",
+            func, ltype_name(x->type), i);
+    }
+
+    for (int i = first; i < a->count; i++) {
+        lval* x = a->cell[i];
+        char buf[40];
+        char* s = buf;
+        char* big = NULL;
+        int n;
+        switch (x->type) {
+            case LVAL_STR: s = x->str; n = x->slen; break;
+            case LVAL_BUILDER: n = x->blen; break;
+            case LVAL_DBL:
+                lval_dbl_fmt(x->dbl, buf);
+                n = strlen(buf);
+            break;
+            default:
+                if (x->big) {
+                    s = big = lbig_str(x->big);
+                    n = strlen(s);
+                } else {
+                    n = snprintf(buf, sizeof(buf), "%li", x->num);
+                }
+            break;
+        }
+
+        // sb-str has to be able to make a String of it, so the same limit as str-concat
+        lval* err = NULL;
+        if (n >= INT_MAX - b->blen) {
+            err = lval_err("Function '%s' would make text that is too long.", func);
+        } else if (!lval_builder_grow(b, n)) {
+            err = lmem_refused(lval_err("Function '%s' couldn't get the memory for the text.", func));
+        } else {
+            // x may be b itself, so its text is only looked for once the room is made
+            if (x->type == LVAL_BUILDER) { s = x->bbuf; }
+            memcpy(b->bbuf + b->blen, s, n);
+            b->blen += n;
+        }
+        free(big);
+
+        if (err) {
+            lval_del(a);
+            return err;
+        }
+    }
+    return NULL;
+}
+
+// (sb-new x ...) is a new builder holding the text of the args
+lval* builtin_sb_new(lenv* e, lval* a) {
+    lval* b = lval_builder();
+    lval* err = lval_builder_add(b, a, "sb-new", 0);
+    if (err) {
+        lval_del(b);
+        return err;
+    }
+    lval_del(a);
+    return b;
+}
+
+// (sb-append b x ...) adds the text of the args to the end of b
+lval* builtin_sb_append(lenv* e, lval* a) {
+    LASSERT(a, a->count > 0, "Function 'sb-append' passed no arguments.");
+    LASSERT_TYPE(a, "sb-append", 0, LVAL_BUILDER);
+
+    lval* b = lval_copy(a->cell[0]);
+    lval* err = lval_builder_add(b, a, "sb-append", 1);
+    lval_del(b);
+    if (err) { return err; }
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* builtin_sb_len(lenv* e, lval* a) {
+    LASSERT_NUM(a, "sb-len", 1);
+    LASSERT_TYPE(a, "sb-len", 0, LVAL_BUILDER);
+
+    lval* n = lval_num(a->cell[0]->blen);
+    lval_del(a);
+    return n;
+}
+
+// (sb-str b) copies b's text into a String
+lval* builtin_sb_str(lenv* e, lval* a) {
+    LASSERT_NUM(a, "sb-str", 1);
+    LASSERT_TYPE(a, "sb-str", 0, LVAL_BUILDER);
+
+    lval* s = lval_str_n(a->cell[0]->bbuf, a->cell[0]->blen);
+    lval_del(a);
+    return s;
+}
+
+lval* builtin_sb_clear(lenv* e, lval* a) {
+    LASSERT_NUM(a, "sb-clear", 1);
+    LASSERT_TYPE(a, "sb-clear", 0, LVAL_BUILDER);
+
+    a->cell[0]->blen = 0;
+    lval_del(a);
+    return lval_sexpr();
+}
+
+lval* lslab_stats(lslab* s) {
+    lval* v = lval_add(lval_qexpr(), lval_num(s->allocs));
+    v = lval_add(v, lval_num(s->frees));
+    v = lval_add(v, lval_num(s->live));
+    v = lval_add(v, lval_num(s->peak));
+    return v;
+}
+
+// (alloc-stats "lval") or (alloc-stats "lenv") -> {allocs frees live peak}
+lval* builtin_alloc_stats(lenv* e, lval* a) {
+    LASSERT_NUM(a, "alloc-stats", 1);
+    LASSERT_TYPE(a, "alloc-stats", 0, LVAL_STR);
+
+    lslab* s = NULL;
+    if (strcmp(a->cell[0]->str, "lval") == 0) { s = &lval_slab; }
+    if (strcmp(a->cell[0]->str, "lenv") == 0) { s = &lenv_slab; }
+    LASSERT(a, s != NULL, "Function 'alloc-stats' passed unknown pool \"%s\"", a->cell[0]->str);
+
+    lval_del(a);
+    return lslab_stats(s);
+}
+
+// forward declaration, allows us to use lval_print before it is defined: sometimes lval_expr_print needs it
+void lval_print(lval* v);
+
+// for Sexprs
+void lval_expr_print(lval* v, char open, char close) {
+    putchar(open);
+    for (int i = 0; i < v->count; i++) {
+        lval_print(v->cell[i]);
+        if (i != v->count - 1) {
+            putchar(' ');
+        }
+    }
+    putchar(close);
+}
+
+void lval_print_str(lval* v) {
+    char* escaped = malloc(v->slen+1);
+    memcpy(escaped, v->str, v->slen+1);
+    escaped = mpcf_escape(escaped);
+    printf("\"%s\"", escaped);
+    free(escaped);
+}
+
+void lval_print(lval* v) {
+    switch (v->type) {
+        case LVAL_NUM:
+            if (v->big) {
+                char* s = lbig_str(v->big);
+                fputs(s, stdout);
+                free(s);
+            } else {
+                printf("%li", v->num);
+            }
+        break;
+        case LVAL_DBL: {
+            char buf[40];
+            lval_dbl_fmt(v->dbl, buf);
+            fputs(buf, stdout);
+        }
+        break;
+        // builders are written out as they are, their text is what is being built
+        case LVAL_BUILDER: fwrite(v->bbuf, 1, v->blen, stdout); break;
+        case LVAL_ERR: printf("Error: %s", v->err); break;
+        case LVAL_SYM: printf("%s", v->sym); break;
+        case LVAL_STR: lval_print_str(v); break;
+        case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
+        case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
+        // one that is inside itself is [...] or #{...} the second time round
+        case LVAL_VEC:
+            if (lpath_has(&lprint_path, v)) { printf("[...]"); break; }
+            lpath_push(&lprint_path, v);
+            putchar('[');
+            for (int i = 0; i < v->vlen; i++) {
+                lval* x = lval_vec_get(v, i);
+                lval_print(x);
+                lval_del(x);
+                if (i != v->vlen - 1) { putchar(' '); }
+            }
+            putchar(']');
+            lprint_path.count--;
+        break;
+        case LVAL_MAP: {
+            if (lpath_has(&lprint_path, v)) { printf("#{...}"); break; }
+            lpath_push(&lprint_path, v);
+            lmap* m = v->map;
+            int first = 1;
+            printf("#{");
+            for (int i = 0; i < m->used; i++) {
+                if (!m->keys[i]) { continue; }
+                if (!first) { putchar(' '); }
+                first = 0;
+                lval_print(m->keys[i]); putchar(' '); lval_print(m->vals[i]);
+            }
+            putchar('}');
+            lprint_path.count--;
+        }
+        break;
+        case LVAL_FUN: 
+            if (v->builtin) {
+                printf("<builtin>");
+            } else {
+                printf("(\\"); 
+                lval_print(v->formals);
+                putchar(' '); lval_print(v->body); putchar(')');
+            }
+            break;
+    }
+}
+
+
+void lval_println(lval* v) { lval_print(v); putchar('\n'); }
+
+void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
+    lval* k = lval_sym(name);
+    lval* v = lval_fun(func);
+    lenv_put(e, k, v);
+    lval_del(k);
+    lval_del(v);
+}
+
+lval* builtin_gc(lenv* e, lval* a);
+lval* builtin_mem_quota(lenv* e, lval* a);
+lval* builtin_mem_stats(lenv* e, lval* a);
+
+void lenv_add_builtins(lenv* e) {
+    /* Variable Functions */
+    lenv_add_builtin(e, "\\", builtin_lambda);
+    lenv_add_builtin(e, "def", builtin_def);
+    lenv_add_builtin(e, "=", builtin_put);
+    lenv_add_builtin(e, "let", builtin_let);
+    /* List Functions */
+    lenv_add_builtin(e, "list", builtin_list);
+    lenv_add_builtin(e, "head", builtin_head);
+    lenv_add_builtin(e, "tail", builtin_tail);
+    lenv_add_builtin(e, "eval", builtin_eval);
+    lenv_add_builtin(e, "join", builtin_join);
+    /* Arithmetic Functions */
+    lenv_add_builtin(e, "+", builtin_add);
+    lenv_add_builtin(e, "-", builtin_sub);
+    lenv_add_builtin(e, "*", builtin_mul);
+    lenv_add_builtin(e, "/", builtin_div);
+    /* Compare Functions */
+    lenv_add_builtin(e, "if", builtin_if);
+    lenv_add_builtin(e, "and", builtin_and);
+    lenv_add_builtin(e, "or", builtin_or);
+    lenv_add_builtin(e, "cond", builtin_cond);
+    /* Loop Functions */
+    lenv_add_builtin(e, "while", builtin_while);
+    lenv_add_builtin(e, "dotimes", builtin_dotimes);
+    lenv_add_builtin(e, "for-each", builtin_for_each);
+    lenv_add_builtin(e, "==", builtin_eq);
+    lenv_add_builtin(e, "!=", builtin_neq);
+    lenv_add_builtin(e, ">", builtin_great);
+    lenv_add_builtin(e, "<", builtin_less);
+    lenv_add_builtin(e, "<=", builtin_lessoreq);
+    lenv_add_builtin(e, ">=", builtin_greatoreq);
+    /* Math functions */
+    lenv_add_builtin(e, "sqrt", builtin_sqrt);
+    lenv_add_builtin(e, "exp", builtin_exp);
+    lenv_add_builtin(e, "log", builtin_log);
+    lenv_add_builtin(e, "sin", builtin_sin);
+    lenv_add_builtin(e, "cos", builtin_cos);
+    lenv_add_builtin(e, "tan", builtin_tan);
+    lenv_add_builtin(e, "floor", builtin_floor);
+    lenv_add_builtin(e, "ceil", builtin_ceil);
+    /* Map functions */
+    lenv_add_builtin(e, "map-from", builtin_map_from);
+    lenv_add_builtin(e, "map-get", builtin_map_get);
+    lenv_add_builtin(e, "map-put", builtin_map_put);
+    lenv_add_builtin(e, "map-del", builtin_map_del);
+    lenv_add_builtin(e, "map-has", builtin_map_has);
+    lenv_add_builtin(e, "map-len", builtin_map_len);
+    lenv_add_builtin(e, "map-keys", builtin_map_keys);
+    lenv_add_builtin(e, "map-vals", builtin_map_vals);
+    lenv_add_builtin(e, "map-items", builtin_map_items);
+    lenv_add_builtin(e, "map-each", builtin_map_each);
+    /* Vector functions */
+    lenv_add_builtin(e, "vec", builtin_vec);
+    lenv_add_builtin(e, "vec-make", builtin_vec_make);
+    lenv_add_builtin(e, "vec-len", builtin_vec_len);
+    lenv_add_builtin(e, "vec-ref", builtin_vec_ref);
+    lenv_add_builtin(e, "vec-set!", builtin_vec_set);
+    lenv_add_builtin(e, "vec-slice", builtin_vec_slice);
+    lenv_add_builtin(e, "vec-fill!", builtin_vec_fill);
+    lenv_add_builtin(e, "list->vec", builtin_list_to_vec);
+    lenv_add_builtin(e, "vec->list", builtin_vec_to_list);
+    /* String functions */
+    lenv_add_builtin(e, "load", builtin_load);
+    lenv_add_builtin(e, "print", builtin_print);
+    lenv_add_builtin(e, "error", builtin_error);
+    lenv_add_builtin(e, "str-len", builtin_str_len);
+    lenv_add_builtin(e, "str-concat", builtin_str_concat);
+    lenv_add_builtin(e, "substr", builtin_substr);
+    lenv_add_builtin(e, "str-find", builtin_str_find);
+    lenv_add_builtin(e, "str-split", builtin_str_split);
+    lenv_add_builtin(e, "sb-new", builtin_sb_new);
+    lenv_add_builtin(e, "sb-append", builtin_sb_append);
+    lenv_add_builtin(e, "sb-len", builtin_sb_len);
+    lenv_add_builtin(e, "sb-str", builtin_sb_str);
+    lenv_add_builtin(e, "sb-clear", builtin_sb_clear);
+    /* Memory functions */
+    lenv_add_builtin(e, "alloc-stats", builtin_alloc_stats);
+    lenv_add_builtin(e, "gc", builtin_gc);
+    lenv_add_builtin(e, "mem-quota", builtin_mem_quota);
+    lenv_add_builtin(e, "mem-stats", builtin_mem_stats);
+}
+
+
+// f may be shared (it usually comes straight out of an env), so it is never changed here:
+// the args are moved out of a into a new frame holding f's env's bindings (whose parent is e).
+// if that binds every formal the frame is returned, ready to evaluate f's body in. otherwise
+// NULL is returned and *r is set to the error, or to a new partially applied function which
+// the frame escapes into
+lenv* lval_bind(lenv* e, lval* f, lval* a, lval** r) {
+    int given = a->count;
+    int total = f->formals->count;
+
+    lval* formals = f->formals;
+    lenv* env = lenv_frame(f->env->count + total);
+    for (int j = 0; j < f->env->count; j++) {
+        lenv_put_sym(env, f->env->syms[j], f->env->vals[j]);
+    }
+    // next formal to bind
+    int i = 0;
+
+    // while args still left to be processed
+    while (a->count) {
+        // err check: no more formals to bind
+        if (i == formals->count) {
+            lenv_del(env); lval_del(a); 
+            *r = lval_err("Function passed too many args. Got %i, expected %i",
+            given, total);
+            return NULL;
+        }
+
+        // take next symbol from formals
+        lval* sym = formals->cell[i++];
+
+        // special case to deal with '&'
+        if (sym->sym == lsym_amp) {
+            if (formals->count - i != 1) {
+                lenv_del(env); lval_del(a);
+                *r = lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
+                return NULL;
+            }
+
+            // next formal should be bound to remaining args
+            lval* nsym = formals->cell[i++];
+            lenv_bind_sym(env, nsym->sym, builtin_list(e, a));
+            a = NULL;
+            break;
+        }
+
+        // move the next arg into the frame
+        lenv_bind_sym(env, sym->sym, lval_pop(a, 0));
+    }
+
+    if (a) { lval_del(a); }
+
+    if (i < formals->count && formals->cell[i]->sym == lsym_amp) {
+            
+        if (formals->count - i != 2) {
+            lenv_del(env);
+            *r = lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
+            return NULL;
+        }
+    
+        lenv_bind_sym(env, formals->cell[i+1]->sym, lval_qexpr());
+        i += 2;
+    }   
+    
+
+    // if all formals have been bound, the env is ready
+    if (i == formals->count) {
+        env->parent = e;
+        return env;
+    } 
+    // otherwise return partially evaluated function
+    else {
+        lval* rest = lval_qexpr();
+        for (; i < formals->count; i++) {
+            rest = lval_add(rest, lval_copy(formals->cell[i]));
+        }
+
+        lval* p = lval_lambda(rest, lval_copy(f->body));
+        lenv_del(p->env);
+        lenv_unstack(env, env->count);
+        p->env = env;
+        *r = p;
+        return NULL;
+    }
+
+}
+
+lval* lval_call(lenv* e, lval* f, lval* a) {
+    if (f->builtin) { return f->builtin(e,a); }
+
+    lval* r;
+    lenv* env = lval_bind(e, f, a, &r);
+    if (!env) { return r; }
+
+    lval* x = builtin_eval(
+        env, lval_add(lval_sexpr(), lval_copy(f->body))
+    );
+    lenv_del(env);
+    return x;
+}
+
+
+/* Evaluation */
+// lval_eval is a loop rather than recursing for anything in tail position: the body of a called
+// lambda, whatever a special form leaves to evaluate (the branch picked by if, the last arg of
+// and/or, the matching cond clause, the body of let) and the expression passed to eval replace v
+// and go round the loop again, so tail recursive functions run in constant C stack
+
+// the lambda we just tail called from is finished with its frame. the new frame takes over its
+// bindings (unless shadowed) and its parent, so dynamically scoped lookups see exactly what they
+// would have through the old frame, but the chain of frames doesn't grow with every iteration.
+// old is deleted, and since frame was made right above it on the frame stack, frame slides
+// down into its place so the stack doesn't grow either
+void lenv_replace_frame(lenv* frame, lenv* old) {
+    for (int i = 0; i < old->count; i++) {
+        if (lenv_find(frame, old->syms[i]) < 0) {
+            lenv_put_sym(frame, old->syms[i], old->vals[i]);
+        }
+    }
+    frame->parent = old->parent;
+
+    int adjacent = old->stacked && frame->stacked && old->syms + old->cap == frame->syms;
+    char** syms = old->syms;
+    lval** vals = old->vals;
+    lenv_del(old);
+
+    if (adjacent) {
+        memmove(syms, frame->syms, sizeof(char*) * frame->count);
+        memmove(vals, frame->vals, sizeof(lval*) * frame->count);
+        frame->syms = syms;
+        frame->vals = vals;
+        lframe_top = (syms - lframe_syms) + frame->cap;
+    }
+}
+
+// looks at an S-Expression whose children have all been evaluated. if there is a function to
+// apply, it is popped off and returned. otherwise returns NULL with *r set to the result: the
+// first error among the children, () or the single value, or an error if it doesn't start
+// with a function
+lval* lval_eval_head(lval* v, lval** r) {
+    // error checking
+    for (int i=0; i < v->count; i++) {
+        if (v->cell[i]->type == LVAL_ERR) { *r = lval_take(v, i); return NULL; }
+    }
+
+    if (v->count == 0) { *r = v; return NULL; }
+    if (v->count == 1) { *r = lval_take(v, 0); return NULL; }
+
+    // ensure first element is func after eval
+    lval* f = lval_pop(v, 0);
+    if (f->type != LVAL_FUN) {
+        *r = lval_err(
+            "S-Expression starts with incorrect type. Got %s, expected %s.", 
+            ltype_name(f->type), ltype_name(LVAL_FUN)
+        );
+        lval_del(f);
+        lval_del(v);
+        return NULL;
+    }
+
+    return f;
+}
+
+lval* lmem_exceeded(void);
+lval* lmem_check(lval* x);
+lval* lval_eval_tree(lenv* e, lval* v) {
+    // the frame of the lambda we have tail called into, if any. nothing else refers to it
+    lenv* frame = NULL;
+    lval* result;
+
+    while (1) {
+        // everything the evaluators hold is consistent here, so it is safe to collect
+        if (lgc_pending) { lgc_collect(); }
+        if (lmem_over) {
+            result = lmem_exceeded();
+            if (result) {
+                lval_del(v);
+                break;
+            }
+        }
+
+        if (v->type == LVAL_SYM) {
+            result = lenv_get(e, v);
+            lval_del(v);
+            break;
+        }
+
+        if (v->type != LVAL_SEXPR) {
+            result = v;
+            break;
+        }
+
+        // a call on constants that was worked out when the function was made
+        lval* k = lval_folded(v);
+        if (k) {
+            result = lval_copy(k);
+            lval_del(v);
+            break;
+        }
+
+        // the head decides whether the rest get evaluated at all
+        lval* h = (v->count > 1) ? lval_eval_tree(e, lval_copy(v->cell[0])) : NULL;
+        if (h && lform_is(h, v)) {
+            lbuiltin form = h->builtin;
+            lval_del(h);
+
+            lenv* env = e;
+            lval* next;
+            result = lform_run(&env, form, v->cell + 1, v->count - 1, &next);
+            lval_del(v);
+            if (!next) { break; }
+
+            // tail position: carry on with what is left of the form, in the frame let made if any
+            if (env != e) {
+                if (frame) { lenv_replace_frame(env, frame); }
+                frame = env;
+                e = env;
+            }
+            v = lval_own(next);
+            v->type = LVAL_SEXPR;
+            continue;
+        }
+
+        // children get replaced by their values below, so make sure v isn't shared (e.g. a function body)
+        v = lval_own(v);
+
+        // evaluate children
+        for (int i=0; i < v->count; i++) {
+            if (i == 0 && h) {
+                lval_del(v->cell[0]);
+                v->cell[0] = h;
+                continue;
+            }
+            // the child is handed over, so v mustn't point at it meanwhile (the collector looks)
+            lval* x = v->cell[i];
+            v->cell[i] = NULL;
+            v->cell[i] = lval_eval_tree(e, x);
+        }   
+
+        lval* f = lval_eval_head(v, &result);
+        if (!f) { break; }
+
+        // tail position: carry on with the expression (or the error) in this env
+        if (f->builtin == builtin_eval) {
+            v = builtin_eval_expr(v);
+            lval_del(f);
+            continue;
+        }
+
+        if (f->builtin) {
+            result = lmem_check(f->builtin(e, v));
+            lval_del(f);
+            break;
+        }
+
+        lenv* env = lval_bind(e, f, v, &result);
+        if (!env) {
+            lval_del(f);
+            break;
+        }
+
+        // carry on with the body of the lambda in its new frame
+        v = lval_own(lval_copy(f->body));
+        v->type = LVAL_SEXPR;
+        lval_del(f);
+
+        if (frame) { lenv_replace_frame(env, frame); }
+        frame = env;
+        e = env;
     }
 
-    lval_del(y);
-    return x;
+    if (frame) { lenv_del(frame); }
+    return result;
 }
 
-/* Lisp Environment */
-// stores data on names & vals relationships of variables in the code 
 
-struct lenv {
-    lenv* parent; // we use this so that we can refer to builtin fns in the global env 
+/* Bytecode VM */
+// --vm mode. rather than walking the tree again every time, a list that gets evaluated is
+// compiled once into a flat run of instructions working on a value stack, and the code is
+// cached on the list itself, so function bodies, if branches and Q-Expressions passed to eval
+// are only compiled the first time round. the VM must give exactly what lval_eval_tree gives,
+// errors included, and it runs tail calls in the same way
+
+enum { LOP_CONST, LOP_LOAD, LOP_CALL, LOP_TAIL, LOP_HEAD, LOP_FORM };
+
+typedef struct linst {
+    int op;
+    int n;      // CALL/TAIL: how many values to take off the stack, HEAD/FORM: how far the call is
+    lval* x;    // CONST: the value to push, LOAD: the symbol to look up, HEAD/FORM: the list
+} linst;
+
+// the compiled code itself. lvm_run holds on to the code it is running, which can go stale
+// under it (a call it makes redefines something that was folded, then gets back to the same
+// list) or be dropped along with the list's chunk, so whoever lets go last frees it
+typedef struct lcode {
+    int refs;       // the chunk it is cached on, and every lvm_run running it
     int count;
-    char** syms;
-    lval** vals;
+    int cap;
+    linst* code;
+    int epoch;      // lfold_epoch when the code was compiled, older code is stale
+} lcode;
+
+struct lchunk {
+    lcode* run;     // the code, if the list has been compiled
+    lval* folded;   // the constant this list folds to, if any
+    int fold_epoch; // lfold_epoch when it was folded
 };
 
-lenv* lenv_new(void) {
-    lenv* e = malloc(sizeof(lenv));
-    e->parent = NULL;
-    e->count = 0;
-    e->syms = NULL;
-    e->vals = NULL;
-    return e;
-}
+int lvm_enabled = 0;
 
-void lenv_del(lenv* e) {
-    for (int i=0; i < e->count; i++) {
-        free(e->syms[i]);
-        lval_del(e->vals[i]); // del because vals is an lval struct. del frees for all cases; using free would lead to potential memory leaks
+lval** lvm_stack = NULL;
+int lvm_sp = 0;
+int lvm_cap = 0;
+
+// HEAD and FORM only borrow their list, it is the one the chunk belongs to or inside it
+void lcode_release(lcode* c) {
+    if (--c->refs > 0) { return; }
+    for (int i = 0; i < c->count; i++) {
+        if (c->code[i].x && c->code[i].op < LOP_HEAD) { lval_del(c->code[i].x); }
     }
-    free(e->syms);
-    free(e->vals);
-    free(e);
+    lmem_free(c->code, sizeof(linst) * c->cap);
+    lmem_free(c, sizeof(lcode));
 }
 
-// since we have an lval type that creates envs, and we can copy that lval type, we need to also be able to copy lenv types
-lenv* lenv_copy(lenv* e) {
-    lenv* n = malloc(sizeof(lenv));
-    n->parent = e->parent;
-    n->count = e->count;
-    n->syms = malloc(sizeof(char*) * n->count);
-    n->vals = malloc(sizeof(lval*) * n->count);
-    for (int i = 0; i < e->count; i++) {
-        n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-        strcpy(n->syms[i], e->syms[i]);
-        n->vals[i] = lval_copy(e->vals[i]);
-    }
+void lchunk_del(lchunk* c) {
+    if (c->run) { lcode_release(c->run); }
+    if (c->folded) { lval_del(c->folded); }
+    lmem_free(c, sizeof(lchunk));
+}
 
-    return n;
+void lcode_emit(lcode* c, int op, int n, lval* x) {
+    if (c->count == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 8;
+        c->code = lmem_realloc(c->code, sizeof(linst) * c->cap, sizeof(linst) * cap);
+        c->cap = cap;
+    }
+    c->code[c->count].op = op;
+    c->code[c->count].n = n;
+    c->code[c->count].x = x;
+    c->count++;
 }
 
-lval* lenv_get(lenv* e, lval* k) {
-    for (int i=0; i < e->count; i++) {
-        if (strcmp(e->syms[i], k->sym) == 0) {
-            return lval_copy(e->vals[i]);
+void lvm_compile_list(lcode* c, lval* l, int tail);
+
+// code that pushes the value of x
+void lvm_compile_expr(lcode* c, lval* x) {
+    switch (x->type) {
+        case LVAL_SYM: lcode_emit(c, LOP_LOAD, 0, lval_copy(x)); break;
+        case LVAL_SEXPR: {
+            lval* k = lval_folded(x);
+            if (k) { lcode_emit(c, LOP_CONST, 0, lval_copy(k)); }
+            else { lvm_compile_list(c, x, 0); }
+            break;
         }
+        default: lcode_emit(c, LOP_CONST, 0, lval_copy(x)); break;
     }
+}
 
-    if (e->parent) {
-        return lenv_get(e->parent, k);
-    } else {
-        return lval_err("Unbound symbol '%s'", k->sym);
+// code that evaluates the contents of l as an S-Expression. in tail position that finishes the chunk
+void lvm_compile_list(lcode* c, lval* l, int tail) {
+    // ((...)) is just the value of (...)
+    if (l->count == 1 && l->cell[0]->type == LVAL_SEXPR) {
+        lvm_compile_list(c, l->cell[0], tail);
+        return;
     }
-}
 
-void lenv_put(lenv* e, lval* k, lval* v) {
-    // iterate through all elements in the env, see if the var already exists
-    for (int i=0; i < e->count; i++) {
+    // the head decides whether the rest are evaluated at all. HEAD loads a symbol and checks it,
+    // FORM checks any other head once it has been worked out. for a special form they run it on
+    // l and skip the code of an ordinary call
+    int head = -1;
+    for (int i = 0; i < l->count; i++) {
+        if (i == 0 && l->count > 1 && l->cell[0]->type == LVAL_SYM) {
+            head = c->count;
+            lcode_emit(c, LOP_HEAD, 0, l);
+            continue;
+        }
 
-        // if the var exists, delete the val in that position and replace with new
-        if (strcmp(e->syms[i], k->sym) == 0){
-            lval_del(e->vals[i]);
-            e->vals[i] = lval_copy(v);
-            return;
+        lvm_compile_expr(c, l->cell[i]);
+        if (i == 0 && l->count > 1) {
+            head = c->count;
+            lcode_emit(c, LOP_FORM, 0, l);
         }
     }
+    lcode_emit(c, tail ? LOP_TAIL : LOP_CALL, l->count, NULL);
+    if (head >= 0) { c->code[head].n = c->count - 1 - head; }
+}
 
-    // else if var doesn't exist, add space for it
-    e->count++;
-    e->vals = realloc(e->vals, sizeof(lval*) * e->count);
-    e->syms = realloc(e->syms, sizeof(char*) * e->count);
+// the code of l, held on to in *run in place of whatever code *run held before
+linst* lvm_code(lval* l, lcode** run) {
+    if (!l->code) {
+        l->code = lmem_calloc(1, sizeof(lchunk));
+    }
 
-    // copy contents of lval and symbol string into new location
-    e->vals[e->count-1] = lval_copy(v);
-    e->syms[e->count-1] = malloc(strlen(k->sym)+1);
-    strcpy(e->syms[e->count-1], k->sym);
-}
+    // the code may have constants in it that were folded from a call which means something else
+    // now. it is compiled again into new code, as the old may still be running
+    lchunk* c = l->code;
+    if (c->run && c->run->epoch != lfold_epoch) {
+        lcode_release(c->run);
+        c->run = NULL;
+    }
 
-void lenv_def(lenv* e, lval* k, lval* v) {
-    // iterate till e has no parent
-    while(e->parent) {  e = e->parent;  }
-    lenv_put(e, k, v);
-}
+    if (!c->run) {
+        c->run = lmem_calloc(1, sizeof(lcode));
+        c->run->refs = 1;
+        c->run->epoch = lfold_epoch;
+        lvm_compile_list(c->run, l, 1);
+    }
 
+    c->run->refs++;
+    if (*run) { lcode_release(*run); }
+    *run = c->run;
+    return c->run->code;
+}
 
-// forward declarations
-lval* lval_eval(lenv* e, lval* v);
-lval* builtin_op(lenv* e, lval* a, char* op);
-lval* builtin(lenv* e, lval* a, char* func);
+/* Constant folding */
 
-/* Builtins */
+// --no-fold turns this off
+int lfold_enabled = 1;
 
-#define LASSERT(args, cond, fmt, ...) \
-    if (!(cond)) {lval* err = lval_err(fmt, ##__VA_ARGS__); \
-    lval_del(args); return err;} 
+// builtins that always give the same answer for the same arguments and change nothing
+lbuiltin lfold_pure[] = {
+    builtin_add, builtin_sub, builtin_mul, builtin_div,
+    builtin_eq, builtin_neq, builtin_great, builtin_less, builtin_lessoreq, builtin_greatoreq,
+    builtin_sqrt, builtin_exp, builtin_log, builtin_sin, builtin_cos, builtin_tan,
+    builtin_floor, builtin_ceil,
+    builtin_str_len, builtin_str_concat, builtin_substr, builtin_str_find,
+    NULL
+};
 
-#define LASSERT_TYPE(args, func, index, expected) \
-    LASSERT(args, args->cell[index]->type == expected, \
-    "Function '%s' passed incorrect type. Got %s, expected %s.", func, ltype_name(args->cell[index]->type), ltype_name(expected))
+// the constant that v was folded to, as long as that still holds
+lval* lval_folded(lval* v) {
+    if (!v->code || !v->code->folded) { return NULL; }
+    return (v->code->fold_epoch == lfold_epoch) ? v->code->folded : NULL;
+}
 
-#define LASSERT_NUM(args, func, expected) \
-    LASSERT(args, args->count == expected, \
-    "Function '%s' passed incorrect num of args. Got %i, expected %i.", func, args->count, expected) 
+// the pure builtin that sym names everywhere inside a function with these formals, if any
+lbuiltin lfold_builtin(char* sym, lval* formals) {
+    lsym* s = LSYM(sym);
+    if (s->frames || s->global < 0) { return NULL; }
+    for (int i = 0; i < formals->count; i++) {
+        if (formals->cell[i]->sym == sym) { return NULL; }
+    }
 
-#define LASSERT_NOT_EMPTY(args, func, index) \
-    LASSERT(args, args->cell[index]->count != 0, "Function '%s' passed {} for argument %i", func, index)
+    lval* f = lenv_globals->vals[s->global];
+    if (f->type != LVAL_FUN || !f->builtin) { return NULL; }
+    for (int i = 0; lfold_pure[i]; i++) {
+        if (lfold_pure[i] == f->builtin) { return f->builtin; }
+    }
+    return NULL;
+}
 
+// folds every call in x to a pure builtin on constants, remembering the value on the call itself.
+// returns the constant x stands for (a new reference), or NULL if it isn't one
+lval* lval_fold(lval* x, lval* formals) {
+    switch (x->type) {
+        case LVAL_NUM: case LVAL_DBL: case LVAL_STR: return lval_copy(x);
+        case LVAL_SEXPR: case LVAL_QEXPR: break;
+        default: return NULL;
+    }
 
-lval* builtin_head(lenv* e, lval* a) {
-    LASSERT_NOT_EMPTY(a, "head", 0);
-    LASSERT_TYPE(a, "head", 0, LVAL_QEXPR);
-    LASSERT_NUM(a, "head", 1);
+    lval* k = lval_folded(x);
+    if (k) { return lval_copy(k); }
+
+    // fold whatever we can underneath, keeping the arguments in case x is a call on them
+    lval* args = lval_sexpr();
+    int constant = 1;
+    for (int i = 0; i < x->count; i++) {
+        lval* c = lval_fold(x->cell[i], formals);
+        if (c && i > 0) { lval_add(args, c); }
+        else {
+            if (c) { lval_del(c); }
+            if (i > 0) { constant = 0; }
+        }
+    }
 
-    lval* v = lval_take(a, 0);
-    while (v->count > 1) { lval_del(lval_pop(v, 1)); }
-    return v;
-}
+    lbuiltin f = NULL;
+    if (constant && x->type == LVAL_SEXPR && x->count > 1 && x->cell[0]->type == LVAL_SYM) {
+        f = lfold_builtin(x->cell[0]->sym, formals);
+    }
+    if (!f) {
+        lval_del(args);
+        return NULL;
+    }
 
-lval* builtin_tail(lenv* e, lval* a) {
-    LASSERT_NOT_EMPTY(a, "tail", 0);
-    LASSERT_TYPE(a, "tail", 0, LVAL_QEXPR);
-    LASSERT_NUM(a, "tail", 1);
+    // leave errors to happen when (if) the call is actually made
+    lval* r = f(lenv_globals, args);
+    if (r->type == LVAL_ERR) {
+        lval_del(r);
+        return NULL;
+    }
 
-    lval* v = lval_take(a, 0);
-    lval_del(lval_pop(v,0));
-    return v;
+    if (!x->code) { x->code = lmem_calloc(1, sizeof(lchunk)); }
+    if (x->code->folded) { lval_del(x->code->folded); }
+    x->code->folded = lval_copy(r);
+    x->code->fold_epoch = lfold_epoch;
+    LSYM(x->cell[0]->sym)->folded = 1;
+    return r;
 }
 
-lval* builtin_list(lenv* e, lval* a) {
-    a->type = LVAL_QEXPR;
-    return a;
+void lval_fold_body(lval* body, lval* formals) {
+    if (!lfold_enabled) { return; }
+    lval* r = lval_fold(body, formals);
+    if (r) { lval_del(r); }
 }
 
-lval* builtin_eval(lenv* e, lval* a) {
-    LASSERT_TYPE(a, "eval", 0, LVAL_QEXPR);
-    LASSERT_NUM(a, "eval", 1);
-
-    lval* x = lval_take(a, 0);
-    x->type = LVAL_SEXPR;
-    return lval_eval(e, x);
+void lvm_push(lval* x) {
+    if (lvm_sp == lvm_cap) {
+        lvm_cap = lvm_cap ? lvm_cap * 2 : 256;
+        lvm_stack = realloc(lvm_stack, sizeof(lval*) * lvm_cap);
+    }
+    lvm_stack[lvm_sp++] = x;
 }
 
-lval* builtin_if(lenv* e, lval* a) {
-    LASSERT_NUM(a, "if", 3);
-    LASSERT_TYPE(a, "if", 0, LVAL_NUM);
-    LASSERT_TYPE(a, "if", 1, LVAL_QEXPR);
-    LASSERT_TYPE(a, "if", 2, LVAL_QEXPR);
+// the top n values, as an S-Expression
+lval* lvm_pop_args(int n) {
+    lval* a = lval_sexpr();
+    lval_reserve(a, n);
+    lvm_sp -= n;
+    if (n) { memcpy(a->cell, &lvm_stack[lvm_sp], sizeof(lval*) * n); }
+    a->count = n;
+    return a;
+}
 
-    lval* x;
-    a->cell[1]->type = LVAL_SEXPR;
-    a->cell[2]->type = LVAL_SEXPR;
+#if defined(__GNUC__)
+#define LVM_COMPUTED_GOTO
+#endif
 
-    if (a->cell[0]->num) {
-        x = lval_eval(e, lval_pop(a, 1));
-    } else {
-        x = lval_eval(e, lval_pop(a, 2));
+// runs the code of list l in e. takes over the reference to l, like lval_eval does. frame is
+// either NULL or e itself, when e is the frame of a lambda call that is ours to delete
+lval* lvm_run(lenv* e, lval* l, lenv* frame) {
+    lval* result;
+    lcode* run = NULL;
+    if (lgc_pending) { lgc_collect(); }
+    if (lmem_over) {
+        result = lmem_exceeded();
+        if (result) { goto done; }
     }
+    linst* ip = lvm_code(l, &run);
 
-    lval_del(a);
-    return x;
-}
+#ifdef LVM_COMPUTED_GOTO
+    static void* labels[] = { &&op_const, &&op_load, &&op_call, &&op_call, &&op_head, &&op_form };
+    #define LVM_DISPATCH() goto *labels[ip->op]
+#else
+    #define LVM_DISPATCH() goto dispatch
+#endif
 
-lval* builtin_join(lenv* e, lval* a) {
+    LVM_DISPATCH();
 
-    for (int i=0; i < a->count; i++) {
-        LASSERT_TYPE(a, "join", i, LVAL_QEXPR);
+#ifndef LVM_COMPUTED_GOTO
+dispatch:
+    switch (ip->op) {
+        case LOP_CONST: goto op_const;
+        case LOP_LOAD: goto op_load;
+        case LOP_HEAD: goto op_head;
+        case LOP_FORM: goto op_form;
+        default: goto op_call;
     }
+#endif
 
-    lval* x = lval_pop(a, 0);
+op_const:
+    lvm_push(lval_copy(ip->x));
+    ip++;
+    LVM_DISPATCH();
 
-    while (a->count) {
-        lval* y = lval_pop(a, 0);
-        x = lval_join(e,x,y);
-    }
+op_load:
+    lvm_push(lenv_get(e, ip->x));
+    ip++;
+    LVM_DISPATCH();
 
-    lval_del(a);
-    return x;
-}
+op_head:
+    lvm_push(lenv_get(e, ip->x->cell[0]));
 
-lval* builtin_op(lenv* e, lval* a, char* op) {
-    
-    for (int i=0; i < a->count; i++) {
-        if (a->cell[i]->type != LVAL_NUM) {
-            lval_del(a);
-            return lval_err("Cannot operate on non-number!");
+op_form: {
+    lval* h = lvm_stack[lvm_sp-1];
+    if (!lform_is(h, ip->x)) {
+        ip++;
+        LVM_DISPATCH();
+    }
+    lvm_sp--;
+    lbuiltin form = h->builtin;
+    lval_del(h);
+
+    linst* call = ip + ip->n;
+    int tail = (call->op == LOP_TAIL);
+    lenv* env = e;
+    lval* next;
+    lval* x = lform_run(&env, form, ip->x->cell + 1, ip->x->count - 1, &next);
+
+    if (next) {
+        if (tail) {
+            // carry on with what is left of the form, in the frame let made if any
+            if (env != e) {
+                if (frame) { lenv_replace_frame(env, frame); }
+                frame = env;
+                e = env;
+            }
+            lval_del(l);
+            l = next;
+            ip = lvm_code(l, &run);
+            LVM_DISPATCH();
         }
+        x = lvm_run(env, next, (env != e) ? env : NULL);
     }
 
-    // pop the first element
-    lval* x = lval_pop(a, 0);
-
-    // handle cases like "(- 5)" which should evaluate to "-5"
-    if ((strcmp(op, "-") == 0) && a->count == 0) {
-        x->num = -x->num;
+    if (tail) {
+        result = x;
+        goto done;
     }
+    lvm_push(x);
+    ip = call + 1;
+    LVM_DISPATCH();
+}
 
-    // instead, while there are still cases remaining
-    // recursively pop the first of remaining args, evaluate, until no remaining args
-    while (a->count > 0) {
-
-        lval* y = lval_pop(a, 0);
+op_call: {
+    int tail = (ip->op == LOP_TAIL);
+    lval* a = lvm_pop_args(ip->n);
+    lval* x;
 
-        if (strcmp(op, "+") == 0) { x->num += y->num; }
-        if (strcmp(op, "-") == 0) { x->num -= y->num; }
-        if (strcmp(op, "*") == 0) { x->num *= y->num; }
-        if (strcmp(op, "/") == 0) { 
-            if (y->num == 0) {
-                lval_del(x); lval_del(y);
-                x = lval_err("Division by Zero!");
-                break;
+    lval* f = lval_eval_head(a, &x);
+    if (f) {
+        if (f->builtin == builtin_eval) {
+            lval* next = builtin_eval_pick(a);
+            lval_del(f);
+
+            if (next->type == LVAL_ERR) {
+                x = next;
+            } else if (tail) {
+                // carry on with the expression in this env
+                lval_del(l);
+                l = next;
+                ip = lvm_code(l, &run);
+                LVM_DISPATCH();
+            } else {
+                x = lvm_run(e, next, NULL);
+            }
+        } else if (f->builtin) {
+            x = lmem_check(f->builtin(e, a));
+            lval_del(f);
+        } else {
+            lenv* env = lval_bind(e, f, a, &x);
+            if (env && tail) {
+                // carry on with the body of the lambda in its new frame
+                if (frame) { lenv_replace_frame(env, frame); }
+                frame = env;
+                e = env;
+
+                lval_del(l);
+                l = lval_copy(f->body);
+                lval_del(f);
+                if (lgc_pending) { lgc_collect(); }
+                if (lmem_over) {
+                    result = lmem_exceeded();
+                    if (result) { goto done; }
+                }
+                ip = lvm_code(l, &run);
+                LVM_DISPATCH();
+            }
+            if (env) {
+                x = lvm_run(env, lval_copy(f->body), env);
             }
-            x->num /= y->num;   
+            lval_del(f);
         }
-
-        lval_del(y);
     }
 
-    lval_del(a);
-    return x;
+    if (tail) {
+        result = x;
+        goto done;
+    }
+    lvm_push(x);
+    ip++;
+    LVM_DISPATCH();
 }
 
-lval* builtin_add(lenv* e, lval* a) { return builtin_op(e, a, "+"); }
-lval* builtin_sub(lenv* e, lval* a) { return builtin_op(e, a, "-"); }
-lval* builtin_mul(lenv* e, lval* a) { return builtin_op(e, a, "*"); }
-lval* builtin_div(lenv* e, lval* a) { return builtin_op(e, a, "/"); }
+done:
+    if (run) { lcode_release(run); }
+    lval_del(l);
+    if (frame) { lenv_del(frame); }
+    return result;
 
+#undef LVM_DISPATCH
+}
 
-lval* builtin_compare(lenv* e, lval* a, char* op) {
-    if (a->count != 2) {
-        lval_del(a);
-        return lval_err("Expected 2 operands, got %i", a->count);
-    }
-    
-    if (a->cell[0]->type != LVAL_NUM || a->cell[1]->type != LVAL_NUM) {
-        lval_del(a);
-        return lval_err("Cannot operate on non-number!");
+lval* lvm_eval(lenv* e, lval* v) {
+    if (v->type == LVAL_SYM) {
+        lval* x = lenv_get(e, v);
+        lval_del(v);
+        return x;
     }
 
-    lval* x = lval_pop(a, 0);
-    lval* y = lval_pop(a, 0);
-
-    int result;
-    if (strcmp(op, "<") == 0) { result = (x->num < y->num) ? 1 : 0; }
-    if (strcmp(op, ">") == 0) { result = (x->num > y->num) ? 1 : 0; }
-    if (strcmp(op, "<=") == 0) { result = (x->num <= y->num) ? 1 : 0; }
-    if (strcmp(op, ">=") == 0) { result = (x->num >= y->num) ? 1 : 0; }
+    if (v->type == LVAL_SEXPR) {
+        lval* k = lval_folded(v);
+        if (k) {
+            k = lval_copy(k);
+            lval_del(v);
+            return k;
+        }
+        return lvm_run(e, v, NULL);
+    }
+    return v;
+}
 
-    lval_del(a); lval_del(x); lval_del(y);
-    return lval_num(result);
+/* Garbage Collection */
+// reference counting frees everything except cycles, which the mutable types make possible: a
+// Vector or Map can end up holding itself, directly or through lists and functions. this is a
+// mark and sweep over the containers that finds those without having to know where the roots
+// are: take away from each container's refs the references other containers hold to it, and
+// whatever still has some left is held from outside (the global env, frames, the VM stack, the
+// C stack of the evaluator or the REPL). those are the roots, everything reachable from them
+// gets marked, and what is left is only held up by other garbage.
+// a minor collection does the same over just the young containers. references from old ones
+// are simply more references from outside, so young objects that old ones point at are kept
+// without needing any write barrier, and garbage cycles that reach into the old generation are
+// left for the next major collection
+
+long lgc_collections = 0;
+long lgc_minors = 0;
+long lgc_freed = 0;
+double lgc_pause_total = 0;
+double lgc_pause_max = 0;
+
+lval** lgc_objs = NULL;     // the containers, and their refs from before the collection
+int* lgc_refs = NULL;
+int lgc_count = 0;
+int lgc_cap = 0;
+
+lval** lgc_stack = NULL;    // marking work list
+int lgc_sp = 0;
+int lgc_stack_cap = 0;
+
+// only these can hold references to other lvals
+int lval_is_container(lval* v) {
+    switch (v->type) {
+        case LVAL_SEXPR: case LVAL_QEXPR: case LVAL_MAP: return 1;
+        case LVAL_FUN: return v->builtin == NULL;
+        case LVAL_VEC: return v->vkind == LVEC_ANY;
+        default: return 0;
+    }
 }
 
-int lval_eq(lval* x, lval* y) {
-    if (x->type != y->type) { return 0; }
+// calls fn on every lval v holds a reference to
+void lval_each_child(lval* v, void (*fn)(lval*)) {
+    switch (v->type) {
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            for (int i = 0; i < v->count; i++) {
+                if (v->cell[i]) { fn(v->cell[i]); }
+            }
+            if (v->code) {
+                lcode* c = v->code->run;
+                for (int i = 0; c && i < c->count; i++) {
+                    linst* in = &c->code[i];
+                    if (in->x && in->op < LOP_HEAD) { fn(in->x); }
+                }
+                if (v->code->folded) { fn(v->code->folded); }
+            }
+        break;
 
-    switch(x->type) {
-        case LVAL_NUM: return (x->num == y->num);
+        case LVAL_FUN:
+            if (v->builtin) { break; }
+            fn(v->formals);
+            fn(v->body);
+            for (int i = 0; i < v->env->count; i++) { fn(v->env->vals[i]); }
+        break;
 
-        case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
-        case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
-        case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+        case LVAL_VEC:
+            if (v->vkind != LVEC_ANY) { break; }
+            for (int i = 0; i < v->vlen; i++) { fn(v->vcells[i]); }
+        break;
 
-        case LVAL_FUN:
-            if (x->builtin || y->builtin) {
-                return x->builtin == y->builtin;
-            } else {
-                return lval_eq(x->formals, y-> formals) && lval_eq(x->body, y->body);
+        case LVAL_MAP:
+            for (int i = 0; i < v->map->used; i++) {
+                if (v->map->keys[i]) {
+                    fn(v->map->keys[i]);
+                    fn(v->map->vals[i]);
+                }
             }
+        break;
+    }
+}
 
-        case LVAL_QEXPR:
+int lchunk_count(lchunk* c) {
+    return c->run ? c->run->count : 0;
+}
+
+// the same references one at a time: v has lval_slots places that can hold one, and
+// lval_slot(v, i) is what is in place i, or NULL
+long lval_slots(lval* v) {
+    switch (v->type) {
         case LVAL_SEXPR:
-            if (x->count != y->count) { return 0; }
-            for (int i = 0; i < x->count; i++) {
-                if (!lval_eq(x->cell[i], y->cell[i])) { return 0; }
-            }
-        return 1;
-    break;
+        case LVAL_QEXPR: return v->count + (v->code ? lchunk_count(v->code) + 1 : 0);
+        case LVAL_FUN: return v->builtin ? 0 : 2 + v->env->count;
+        case LVAL_VEC: return v->vkind == LVEC_ANY ? v->vlen : 0;
+        case LVAL_MAP: return 2 * v->map->used;
+        default: return 0;
     }
-
-    return 0;
 }
 
-lval* builtin_cmp(lenv* e, lval* a, char* op) {
-    LASSERT_NUM(a, op, 2);
-    lval* x = lval_pop(a, 0);
-    lval* y = lval_pop(a, 0);
-    int result;
-    if (strcmp(op, "==") == 0) {
-        result = lval_eq(x, y);
+lval* lval_slot(lval* v, long i) {
+    switch (v->type) {
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            if (i < v->count) { return v->cell[i]; }
+            i -= v->count;
+            if (i == lchunk_count(v->code)) { return v->code->folded; }
+            return v->code->run->code[i].op < LOP_HEAD ? v->code->run->code[i].x : NULL;
+        case LVAL_FUN:
+            if (i < 2) { return i ? v->body : v->formals; }
+            return v->env->vals[i - 2];
+        case LVAL_VEC: return v->vcells[i];
+        case LVAL_MAP: return (i & 1) ? v->map->vals[i / 2] : v->map->keys[i / 2];
+        default: return NULL;
     }
-    if (strcmp(op, "!=") == 0) {
-        result = !lval_eq(x, y);
+}
+
+// calls fn on what is in v's places numbered from to from + n - 1, and gives the place to carry
+// on from, or -1 once it has got to the end
+long lval_each_slot(lval* v, long from, long n, void (*fn)(lval*)) {
+    long slots = lval_slots(v);
+    long i = from;
+    for (; i < from + n && i < slots; i++) {
+        lval* c = lval_slot(v, i);
+        if (c) { fn(c); }
     }
-    lval_del(a); lval_del(x); lval_del(y);
-    return lval_num(result);
+    return i < slots ? i : -1;
 }
 
-lval* builtin_less(lenv* e, lval* a) { return builtin_compare(e, a, "<"); }
-lval* builtin_great(lenv* e, lval* a) { return builtin_compare(e, a, ">"); }
-lval* builtin_lessoreq(lenv* e, lval* a) { return builtin_compare(e, a, "<="); }
-lval* builtin_greatoreq(lenv* e, lval* a) { return builtin_compare(e, a, ">="); }
-lval* builtin_eq(lenv* e, lval* a) { return builtin_cmp(e, a, "=="); }
-lval* builtin_neq(lenv* e, lval* a) { return builtin_cmp(e, a, "!="); }
+void lgc_gather(void* p) {
+    lval* v = p;
+    if (v->type == LVAL_FREE || (v->gen & LGC_SEEN) || !lval_is_container(v)) { return; }
+    v->gen |= LGC_SEEN;
 
-lval* builtin_lambda(lenv* e, lval* a) {
-    // check 2 args, both Q-Expressions
-    LASSERT_NUM(a, "\\", 2);
-    LASSERT_TYPE(a, "\\", 0, LVAL_QEXPR);
-    LASSERT_TYPE(a, "\\", 1, LVAL_QEXPR);
+    if (lgc_count == lgc_cap) {
+        lgc_cap = lgc_cap ? lgc_cap * 2 : 1024;
+        lgc_objs = realloc(lgc_objs, sizeof(lval*) * lgc_cap);
+        lgc_refs = realloc(lgc_refs, sizeof(int) * lgc_cap);
+    }
+    lgc_objs[lgc_count] = v;
+    lgc_refs[lgc_count] = v->refs;
+    lgc_count++;
+}
 
-    // check that the first Q-Expression contains only symbols
-    for (int i = 0; i < a->cell[0]->count; i++) {
-        LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
-        "Cannot define non-symbol. Got %s, expected %s.",
-        ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+void lgc_gather_young(void* p) {
+    lval* v = p;
+    if (v->type == LVAL_FREE || (v->gen & LGC_OLD_GEN)) { return; }
+
+    // with a budget, a container too big to go through in one slice is made old straight away,
+    // so that only the incremental collection ever has to go through it
+    if (lgc_budget && lval_slots(v) > lgc_budget) {
+        v->gen |= LGC_OLD_GEN;
+        return;
     }
+    lgc_gather(v);
+}
 
-    lval* formals = lval_pop(a, 0);
-    lval* body = lval_pop(a, 0);
-    lval_del(a);
+void lgc_unref(lval* c) {
+    if (c->gen & LGC_SEEN) { c->refs--; }
+}
 
-    return lval_lambda(formals, body);
+// marked containers have refs of -1 until the collection is over
+void lgc_mark(lval* c) {
+    if (!(c->gen & LGC_SEEN) || c->refs < 0) { return; }
+    c->refs = -1;
+
+    if (lgc_sp == lgc_stack_cap) {
+        lgc_stack_cap = lgc_stack_cap ? lgc_stack_cap * 2 : 1024;
+        lgc_stack = realloc(lgc_stack, sizeof(lval*) * lgc_stack_cap);
+    }
+    lgc_stack[lgc_sp++] = c;
 }
 
-lval *builtin_var(lenv* e, lval* a, char* func) {
-    LASSERT_TYPE(a, func, 0, LVAL_QEXPR);
+// drops every reference v holds, leaving it empty but still fine to lval_del
+void lval_gc_clear(lval* v) {
+    switch (v->type) {
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            lval_drop_code(v);
+            for (int i = 0; i < v->count; i++) { lval_del(v->cell[i]); }
+            v->count = 0;
+        break;
 
-    lval* syms = a->cell[0];
-    for (int i = 0; i < syms->count; i++) {
-        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
-        "Function %s cannot define non-symbol. Got %s, expected %s",
-        func, ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+        case LVAL_FUN:
+            lenv_del(v->env);
+            lval_del(v->formals);
+            lval_del(v->body);
+            v->env = lenv_new();
+            v->formals = lval_qexpr();
+            v->body = lval_qexpr();
+        break;
+
+        // vlen stays, lval_del needs it to free the storage. as far as it knows that now holds
+        // numbers
+        case LVAL_VEC:
+            for (int i = 0; i < v->vlen; i++) { lval_del(v->vcells[i]); }
+            v->vkind = LVEC_INT;
+        break;
+
+        case LVAL_MAP:
+            for (int i = 0; i < v->map->used; i++) {
+                if (v->map->keys[i]) {
+                    lval_del(v->map->keys[i]);
+                    lval_del(v->map->vals[i]);
+                    v->map->keys[i] = v->map->vals[i] = NULL;
+                }
+            }
+            v->map->count = 0;
+        break;
     }
+}
 
-    LASSERT(a, (syms->count == a->count-1), 
-    "Function '%s' passed too many arguments for symbols. Got %i, expected %i",
-    func, syms->count, a->count-1);
+// frees every container lgc_gather has been given that is only reachable from garbage, returns
+// how many there were
+long lgc_sweep(void) {
+    // what is left in refs is how many references come from outside the containers
+    for (int i = 0; i < lgc_count; i++) { lval_each_child(lgc_objs[i], lgc_unref); }
 
-    // if 'def' define globally, if 'put' define locally
-    for (int i = 0; i < syms->count; i++) {
-        if (strcmp(func, "def") == 0) {
-            lenv_def(e, syms->cell[i], a->cell[i+1]);
-        }
+    for (int i = 0; i < lgc_count; i++) {
+        if (lgc_objs[i]->refs <= 0) { continue; }
+        lgc_mark(lgc_objs[i]);
+        while (lgc_sp) { lval_each_child(lgc_stack[--lgc_sp], lgc_mark); }
+    }
 
-        if (strcmp(func, "=") == 0) {
-            lenv_put(e, syms->cell[i], a->cell[i+1]);
+    // put the refs back, keeping hold of the garbage with one more each so that nothing is
+    // freed out from under us while the cycles are taken apart. the survivors are now old (and
+    // still in an incremental collection's set, if they were)
+    int dead = 0;
+    for (int i = 0; i < lgc_count; i++) {
+        lval* v = lgc_objs[i];
+        int marked = (v->refs < 0);
+        v->refs = lgc_refs[i];
+        v->gen = LGC_OLD_GEN | (v->gen & (LGC_INC | LGC_IMARK | LARENA_OWNER));
+        if (!marked) {
+            v->refs++;
+            lgc_objs[dead++] = v;
         }
     }
 
-    lval_del(a);
-    return lval_sexpr();
+    for (int i = 0; i < dead; i++) { lval_gc_clear(lgc_objs[i]); }
+    for (int i = 0; i < dead; i++) { lval_del(lgc_objs[i]); }
+    return dead;
 }
 
-lval* builtin_def(lenv* e, lval* a) { return builtin_var(e, a, "def"); }
-lval* builtin_put(lenv* e, lval* a) { return builtin_var(e, a, "="); }
+// an incremental collection does a major collection a slice at a time, with the program running
+// (and changing things) in between: CLEAR empties lgc_table, GATHER walks the slab for the
+// containers to look at, COUNT adds up the references they hold to each other, MARK marks from
+// those with more references than that, SCAN lets go of the marked ones, and the rest are the
+// candidates. by then what it worked out may be out of date, so it only goes by that to pick
+// them: the last slice runs the exact collection over just the candidates, which takes about as
+// long as there is garbage. FLUSH then gives back what was freed while still in the set
+enum { LGC_IDLE, LGC_CLEAR, LGC_GATHER, LGC_COUNT, LGC_MARK, LGC_SCAN, LGC_FLUSH };
+
+int lgc_phase = LGC_IDLE;
+long lgc_pos = 0;               // how far the phase has got
+long lgc_slot = 0;              // and how far through the container it is on (see lval_each_slot)
+lval* lgc_cur = NULL;           // the one MARK is on
+long lgc_work = 0;              // steps taken in this slice
+
+lval** lgc_set = NULL;          // the containers, and how many references they have from the set
+int* lgc_set_refs = NULL;
+long lgc_set_count = 0;
+long lgc_set_cap = 0;
+
+int* lgc_table = NULL;          // where each container is in lgc_set, plus one (0 is empty)
+unsigned lgc_table_mask = 0;
+
+lval** lgc_grey = NULL;         // marked, but their children haven't been looked at
+long lgc_grey_count = 0;
+long lgc_grey_cap = 0;
+
+lval** lgc_cands = NULL;
+long lgc_cands_count = 0;
+long lgc_cands_cap = 0;
+
+lval** lgc_deferred = NULL;     // freed while in the set
+long lgc_deferred_count = 0;
+long lgc_deferred_cap = 0;
+
+void lgc_push(lval*** list, long* count, long* cap, lval* v) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, sizeof(lval*) * *cap);
+    }
+    (*list)[(*count)++] = v;
+}
 
-// load and read other files
-lval* builtin_load(lenv* e, lval* a) {
-  LASSERT_NUM("load", a, 1);
-  LASSERT_TYPE("load", a, 0, LVAL_STR);
+void lgc_defer(lval* v) {
+    lgc_push(&lgc_deferred, &lgc_deferred_count, &lgc_deferred_cap, v);
+}
 
-  mpc_result_t r;
-  if (mpc_parse_contents(a->cell[0]->str, Lispy, &r)) {
+void lgc_inc_begin(void) {
+    // room for every lval there is now and some more made while the slab is walked. containers
+    // that don't fit are left out, which just means they count as outside the set
+    long cap = lval_slab.live + lval_slab.live / 4 + 1024;
+    if (cap > lgc_set_cap) {
+        free(lgc_set);
+        free(lgc_set_refs);
+        free(lgc_table);
+        lgc_set_cap = cap;
+        lgc_set = malloc(sizeof(lval*) * cap);
+        lgc_set_refs = malloc(sizeof(int) * cap);
+
+        long size = 1024;
+        while (size < cap * 2) { size *= 2; }
+        lgc_table = malloc(sizeof(int) * size);
+        lgc_table_mask = size - 1;
+    }
+    lgc_set_count = 0;
+    lgc_cands_count = 0;
+    lgc_pos = 0;
+    lgc_phase = LGC_CLEAR;
+}
 
-    lval* expr = lval_read(r.output);
-    mpc_ast_delete(r.output);
+void lgc_inc_gather(void* p) {
+    lval* v = p;
+    lgc_work++;
+    if (v->type == LVAL_FREE || !lval_is_container(v) || lgc_set_count == lgc_set_cap) { return; }
+    v->gen |= LGC_INC;
+
+    unsigned h = lhash_mix((uintptr_t)v) & lgc_table_mask;
+    while (lgc_table[h]) { h = (h + 1) & lgc_table_mask; }
+    lgc_table[h] = lgc_set_count + 1;
+    lgc_set[lgc_set_count] = v;
+    lgc_set_refs[lgc_set_count] = 0;
+    lgc_set_count++;
+}
 
-    // deal with each new expr
-    while (expr->count) {
-      lval* x = lval_eval(e, lval_pop(expr, 0));
-      if (x->type == LVAL_ERR) { lval_println(x); }
-      lval_del(x);
+void lgc_inc_count(lval* c) {
+    lgc_work++;
+    if (!(c->gen & LGC_INC)) { return; }
+
+    unsigned h = lhash_mix((uintptr_t)c) & lgc_table_mask;
+    while (lgc_set[lgc_table[h] - 1] != c) { h = (h + 1) & lgc_table_mask; }
+    lgc_set_refs[lgc_table[h] - 1]++;
+}
+
+void lgc_inc_mark(lval* c) {
+    lgc_work++;
+    if ((c->gen & (LGC_INC | LGC_IMARK)) != LGC_INC) { return; }
+    c->gen |= LGC_IMARK;
+    lgc_push(&lgc_grey, &lgc_grey_count, &lgc_grey_cap, c);
+}
+
+// the exact collection over the candidates. anything that only looked like garbage because the
+// program moved it around during the collection is held from outside them, and is kept
+void lgc_inc_finish(void) {
+    lgc_count = 0;
+    for (long i = 0; i < lgc_cands_count; i++) {
+        if (lgc_cands[i]->type != LVAL_FREE) { lgc_gather(lgc_cands[i]); }
     }
+    lgc_freed += lgc_sweep();
+    lgc_collections++;
 
-    lval_del(expr);
-    lval_del(a);
+    for (long i = 0; i < lgc_cands_count; i++) { lgc_cands[i]->gen &= ~(LGC_INC | LGC_IMARK); }
+    lgc_cands_count = 0;
+    lgc_pos = 0;
+    lgc_phase = LGC_FLUSH;
+}
 
-    return lval_sexpr();
+// does about n steps of the incremental collection: a step is looking at an object, or
+// following a reference from one
+void lgc_inc_slice(long n) {
+    lgc_work = 0;
+    while (lgc_phase != LGC_IDLE && lgc_work < n) {
+        switch (lgc_phase) {
+            case LGC_CLEAR: {
+                // clearing a cache line of the table counts as a step
+                long size = (long)lgc_table_mask + 1;
+                long k = (n - lgc_work) * 16;
+                if (k > size - lgc_pos) { k = size - lgc_pos; }
+                memset(lgc_table + lgc_pos, 0, sizeof(int) * k);
+                lgc_pos += k;
+                lgc_work += k / 16 + 1;
+
+                if (lgc_pos == size) {
+                    lslab_walk_start(&lval_slab);
+                    lgc_phase = LGC_GATHER;
+                }
+            } break;
+
+            case LGC_GATHER:
+                if (!lslab_walk(&lval_slab, n - lgc_work, lgc_inc_gather)) {
+                    lgc_pos = 0;
+                    lgc_phase = LGC_COUNT;
+                }
+            break;
 
-  } else {
-    char* err_msg = mpc_err_string(r.error);
-    mpc_err_delete(r.error);
+            case LGC_COUNT:
+                if (lgc_pos == lgc_set_count) {
+                    lgc_pos = 0;
+                    lgc_phase = LGC_MARK;
+                    break;
+                }
+                lgc_slot = lval_each_slot(lgc_set[lgc_pos], lgc_slot, n - lgc_work, lgc_inc_count);
+                if (lgc_slot < 0) {
+                    lgc_work++;
+                    lgc_slot = 0;
+                    lgc_pos++;
+                }
+            break;
 
-    lval* err = lval_err("Could not load Library %s", err_msg);
-    free(err_msg);
-    lval_del(a);
+            case LGC_MARK:
+                if (lgc_cur) {
+                    lgc_slot = lval_each_slot(lgc_cur, lgc_slot, n - lgc_work, lgc_inc_mark);
+                    if (lgc_slot < 0) {
+                        lgc_slot = 0;
+                        lgc_cur = NULL;
+                    }
+                } else if (lgc_grey_count) {
+                    lgc_work++;
+                    lgc_cur = lgc_grey[--lgc_grey_count];
+                } else if (lgc_pos < lgc_set_count) {
+                    lgc_work++;
+                    lval* v = lgc_set[lgc_pos];
+                    if (v->type != LVAL_FREE && v->refs > lgc_set_refs[lgc_pos]) { lgc_inc_mark(v); }
+                    lgc_pos++;
+                } else {
+                    lgc_pos = 0;
+                    lgc_phase = LGC_SCAN;
+                }
+            break;
 
-    return err;
-  }
+            // candidates stay in the set, so they can't be freed and reused before the end
+            case LGC_SCAN: {
+                if (lgc_pos == lgc_set_count) {
+                    lgc_inc_finish();
+                    break;
+                }
+                lgc_work++;
+                lval* v = lgc_set[lgc_pos++];
+                if (v->type == LVAL_FREE) { break; }
+                if (v->gen & LGC_IMARK) {
+                    v->gen &= ~(LGC_INC | LGC_IMARK);
+                } else {
+                    lgc_push(&lgc_cands, &lgc_cands_count, &lgc_cands_cap, v);
+                }
+            } break;
+
+            case LGC_FLUSH:
+                if (lgc_pos == lgc_deferred_count) {
+                    lgc_deferred_count = 0;
+                    lgc_phase = LGC_IDLE;
+                    break;
+                }
+                lgc_work++;
+                lslab_free(&lval_slab, lgc_deferred[lgc_pos++]);
+            break;
+        }
+    }
 }
 
-lval* builtin_print(lenv* e, lval* a) {
-  for (int i = 0; i < a->count; i++) {
-    lval_print(a->cell[i]); putchar(' ');
-  }
+// drops an unfinished incremental collection, for when a full one is about to happen
+void lgc_inc_abort(void) {
+    if (lgc_phase == LGC_IDLE) { return; }
 
-  putchar('\n');
-  lval_del(a);
+    // SCAN has let go of the ones before lgc_pos, which may be gone by now
+    if (lgc_phase != LGC_FLUSH) {
+        for (long i = (lgc_phase == LGC_SCAN) ? lgc_pos : 0; i < lgc_set_count; i++) {
+            lgc_set[i]->gen &= ~(LGC_INC | LGC_IMARK);
+        }
+        for (long i = 0; i < lgc_cands_count; i++) { lgc_cands[i]->gen &= ~(LGC_INC | LGC_IMARK); }
+        lgc_pos = 0;
+    }
+    for (long i = lgc_pos; i < lgc_deferred_count; i++) { lslab_free(&lval_slab, lgc_deferred[i]); }
 
-  return lval_sexpr();
+    lgc_set_count = lgc_cands_count = lgc_deferred_count = lgc_grey_count = 0;
+    lgc_slot = 0;
+    lgc_cur = NULL;
+    lgc_phase = LGC_IDLE;
 }
 
-lval* builtin_error(lenv* e, lval* a) {
-  LASSERT_NUM("error", a, 1);
-  LASSERT_TYPE("error", a, 0, LVAL_STR);
-  
-  lval* err = lval_err(a->cell[0]->str);
-  
-  lval_del(a);
-  return err;
+// frees every container (young ones only, unless major) that is only reachable from garbage,
+// returns how many there were
+long lgc_collect_now(int major) {
+    lgc_count = 0;
+    if (major) {
+        lgc_inc_abort();
+        lslab_each(&lval_slab, lgc_gather);
+    } else {
+#ifdef LISPY_NO_SLAB
+        lslab_each(&lval_slab, lgc_gather_young);
+#else
+        for (int i = 0; i < lgc_young_count; i++) { lgc_gather_young(lgc_young[i]); }
+#endif
+    }
+    lgc_young_count = 0;
+    return lgc_sweep();
 }
 
-// forward declaration, allows us to use lval_print before it is defined: sometimes lval_expr_print needs it
-void lval_print(lval* v);
+// pause times are counted in buckets an eighth of a power of two wide, so the percentiles
+// worked out from them are at most 12.5% over
+#define LGC_BUCKETS 256
+long lgc_hist[LGC_BUCKETS];
+long lgc_pauses = 0;
+
+int lgc_bucket(long us) {
+    if (us < 8) { return us; }
+    int e = 63 - __builtin_clzl(us);
+    int b = 8 + (e - 3) * 8 + (int)((us >> (e - 3)) & 7);
+    return b < LGC_BUCKETS ? b : LGC_BUCKETS - 1;
+}
 
-// for Sexprs
-void lval_expr_print(lval* v, char open, char close) {
-    putchar(open);
-    for (int i = 0; i < v->count; i++) {
-        lval_print(v->cell[i]);
-        if (i != v->count - 1) {
-            putchar(' ');
+// the longest pause that goes in bucket b
+long lgc_bucket_max(int b) {
+    if (b < 8) { return b; }
+    int e = (b - 8) / 8 + 3;
+    return ((long)(9 + (b - 8) % 8) << (e - 3)) - 1;
+}
+
+void lgc_pause(clock_t start) {
+    double pause = (double)(clock() - start) / CLOCKS_PER_SEC;
+    lgc_pause_total += pause;
+    if (pause > lgc_pause_max) { lgc_pause_max = pause; }
+    lgc_hist[lgc_bucket((long)(pause * 1e6))]++;
+    lgc_pauses++;
+}
+
+// the time in us that p percent of the pauses took at most
+long lgc_percentile(double p) {
+    long max = (long)(lgc_pause_max * 1e6);
+    long seen = 0;
+    for (int b = 0; b < LGC_BUCKETS; b++) {
+        seen += lgc_hist[b];
+        if (seen > 0 && seen >= lgc_pauses * p / 100) {
+            return lgc_bucket_max(b) < max ? lgc_bucket_max(b) : max;
         }
     }
-    putchar(close);
+    return max;
 }
 
-void lval_print_str(lval* v) {
-    char* escaped = malloc(strlen(v->str)+1);
-    strcpy(escaped, v->str);
-    escaped = mpcf_escape(escaped);
-    printf("\"%s\"", escaped);
-    free(escaped);
+// wait for the heap to double before looking at everything again
+void lgc_reset_threshold(void) {
+    lgc_threshold = lval_slab.live * 2;
+    if (lgc_threshold < LGC_MIN) { lgc_threshold = LGC_MIN; }
 }
 
-void lval_print(lval* v) {
-    switch (v->type) {
-        case LVAL_NUM: printf("%li", v->num); break;
-        case LVAL_ERR: printf("Error: %s", v->err); break;
-        case LVAL_SYM: printf("%s", v->sym); break;
-        case LVAL_STR: lval_print_str(v); break;
-        case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
-        case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
-        case LVAL_FUN: 
-            if (v->builtin) {
-                printf("<builtin>");
-            } else {
-                printf("(\\"); 
-                lval_print(v->formals);
-                putchar(' '); lval_print(v->body); putchar(')');
-            }
-            break;
+void lgc_run(int major) {
+    lgc_freed += lgc_collect_now(major);
+    lgc_collections++;
+    if (major) {
+        lgc_reset_threshold();
+    } else {
+        lgc_minors++;
     }
 }
 
+// with a budget, minor collections come after that many young containers (if it's less than
+// LGC_YOUNG), and when it's time for a major one it goes incremental, with a slice of that many
+// steps at every minor collection, or whenever budget / LGC_PACE more lvals are live, whichever
+// comes first. so no pause should take much longer than the budget does, however big the heap
+// gets. a collection takes several steps per lval, and whatever is made while it runs is left
+// for the next one, so slices have to come often enough that the heap grows by well under half
+// while it runs, or each collection would start on a bigger heap than the last. that is also why
+// a slice is never less than LGC_PACE steps, a budget smaller than that couldn't keep up
+#ifndef LGC_PACE
+#define LGC_PACE 16
+#endif
 
-void lval_println(lval* v) { lval_print(v); putchar('\n'); }
+void lgc_step(int major) {
+    if (lgc_young_count >= lgc_young_max) { lgc_run(0); }
+    if (major && lgc_phase == LGC_IDLE) { lgc_inc_begin(); }
+    if (lgc_phase == LGC_IDLE) { return; }
 
-void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
-    lval* k = lval_sym(name);
-    lval* v = lval_fun(func);
-    lenv_put(e, k, v);
-    lval_del(k);
-    lval_del(v);
+    lgc_inc_slice(lgc_budget < LGC_PACE ? LGC_PACE : lgc_budget);
+    if (lgc_phase == LGC_IDLE) {
+        lgc_reset_threshold();
+    } else {
+        lgc_threshold = lval_slab.live + lgc_budget / LGC_PACE + 1;
+    }
 }
 
-void lenv_add_builtins(lenv* e) {
-    /* Variable Functions */
-    lenv_add_builtin(e, "\\", builtin_lambda);
-    lenv_add_builtin(e, "def", builtin_def);
-    lenv_add_builtin(e, "=", builtin_put);
-    /* List Functions */
-    lenv_add_builtin(e, "list", builtin_list);
-    lenv_add_builtin(e, "head", builtin_head);
-    lenv_add_builtin(e, "tail", builtin_tail);
-    lenv_add_builtin(e, "eval", builtin_eval);
-    lenv_add_builtin(e, "join", builtin_join);
-    /* Arithmetic Functions */
-    lenv_add_builtin(e, "+", builtin_add);
-    lenv_add_builtin(e, "-", builtin_sub);
-    lenv_add_builtin(e, "*", builtin_mul);
-    lenv_add_builtin(e, "/", builtin_div);
-    /* Compare Functions */
-    lenv_add_builtin(e, "if", builtin_if);
-    lenv_add_builtin(e, "==", builtin_eq);
-    lenv_add_builtin(e, "!=", builtin_neq);
-    lenv_add_builtin(e, ">", builtin_great);
-    lenv_add_builtin(e, "<", builtin_less);
-    lenv_add_builtin(e, "<=", builtin_lessoreq);
-    lenv_add_builtin(e, ">=", builtin_greatoreq);
-    /* String functions */
-    lenv_add_builtin(e, "load", builtin_load);
-    lenv_add_builtin(e, "print", builtin_print);
-    lenv_add_builtin(e, "error", builtin_error);
+void lgc_set_budget(long n) {
+    lgc_budget = n;
+    lgc_young_max = (n && n < LGC_YOUNG) ? n : LGC_YOUNG;
+    if (!n && lgc_phase != LGC_IDLE) {
+        lgc_inc_abort();
+        lgc_reset_threshold();
+    }
 }
 
+void lgc_collect(void) {
+    clock_t start = clock();
+    int major = (lgc_pending == LGC_MAJOR);
+    lgc_pending = LGC_NONE;
 
-lval* lval_call(lenv* e, lval* f, lval* a) {
-    if (f->builtin) { return f->builtin(e,a); }
-
-    int given = a->count;
-    int total = f->formals->count;
+    if (lgc_budget) {
+        lgc_step(major);
+    } else {
+        lgc_run(major);
+    }
+    lgc_pause(start);
+}
 
-    // while args still left to be processed
-    while (a->count) {
-        // err check: no more formals to bind
-        if (f->formals->count == 0) {
-            lval_del(a); 
-            return lval_err("Function passed too many args. Got %i, expected %i",
-            given, total);
-        }
+// a collection that nothing asked for yet, all in one go. returns how many objects were freed
+long lgc_force(int major) {
+    long freed = lgc_freed;
+    clock_t start = clock();
+    lgc_run(major);
+    lgc_pause(start);
+    return lgc_freed - freed;
+}
 
-        // pop first symbol from formals
-        lval* sym = lval_pop(f->formals, 0);
+// (gc "collect") does a major collection now, all in one go, (gc "minor") a minor one, and both
+// give how many objects were freed. (gc "budget" n) makes major collections incremental, in
+// slices of n steps, or not with 0.
+// (gc "stats") -> {collections freed total-pause-us max-pause-us live-lvals minor-collections}
+// (gc "pauses") -> {pauses p50-us p90-us p99-us p99.9-us max-us}
+lval* builtin_gc(lenv* e, lval* a) {
+    LASSERT(a, a->count == 1 || a->count == 2,
+        "Function 'gc' passed incorrect num of args. Got %i, expected 1 or 2.", a->count);
+    LASSERT_TYPE(a, "gc", 0, LVAL_STR);
+    char* action = a->cell[0]->str;
+
+    if (strcmp(action, "budget") == 0) {
+        LASSERT(a, a->count == 2, "Function 'gc' passed no budget.");
+        LASSERT_TYPE(a, "gc", 1, LVAL_NUM);
+        LASSERT(a, !a->cell[1]->big && a->cell[1]->num >= 0 && a->cell[1]->num <= INT_MAX,
+            "Function 'gc' passed a budget that is out of range.");
+        lgc_set_budget(a->cell[1]->num);
+        lval_del(a);
+        return lval_sexpr();
+    }
+    LASSERT_NUM(a, "gc", 1);
 
-        // special case to deal with '&'
-        if (strcmp(sym->sym, "&") == 0) {
-            if (f->formals->count != 1) {
-                lval_del(a);
-                return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
-            }
+    int minor = (strcmp(action, "minor") == 0);
+    if (minor || strcmp(action, "collect") == 0) {
+        lval_del(a);
+        return lval_num(lgc_force(!minor));
+    }
 
-            // next formal should be bound to remaining args
-            lval* nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);  lval_del(nsym);
-            break;
-        }
+    if (strcmp(action, "pauses") == 0) {
+        lval_del(a);
+        lval* v = lval_add(lval_qexpr(), lval_num(lgc_pauses));
+        v = lval_add(v, lval_num(lgc_percentile(50)));
+        v = lval_add(v, lval_num(lgc_percentile(90)));
+        v = lval_add(v, lval_num(lgc_percentile(99)));
+        v = lval_add(v, lval_num(lgc_percentile(99.9)));
+        v = lval_add(v, lval_num((long)(lgc_pause_max * 1e6)));
+        return v;
+    }
 
-        // pop next arg from the list
-        lval* val = lval_pop(a, 0);
+    LASSERT(a, strcmp(action, "stats") == 0,
+        "Function 'gc' passed unknown action \"%s\"", action);
+    lval_del(a);
 
-        // bind a copy into the function's env
-        lenv_put(f->env, sym, val);
+    lval* v = lval_add(lval_qexpr(), lval_num(lgc_collections));
+    v = lval_add(v, lval_num(lgc_freed));
+    v = lval_add(v, lval_num((long)(lgc_pause_total * 1e6)));
+    v = lval_add(v, lval_num((long)(lgc_pause_max * 1e6)));
+    v = lval_add(v, lval_num(lval_slab.live));
+    v = lval_add(v, lval_num(lgc_minors));
+    return v;
+}
 
-        // delete symbol, delete value
-        lval_del(sym);   lval_del(val);
+// called at the evaluators' safe points once lmem_over is set. garbage cycles count towards
+// lmem_live until they are collected, so before giving up it tries a minor collection (cheap,
+// it only looks at what was made since the last one) and then a major one. a major one that
+// leaves less than a quarter of the quota free isn't tried again, or an evaluation running close
+// to its quota would do nothing but collect. NULL if it can carry on, otherwise the error it
+// stops with
+lval* lmem_exceeded(void) {
+    if (!lmem_tripped) {
+        lgc_force(0);
+        if (lmem_live > lmem_limit && !lmem_crowded) {
+            lgc_force(1);
+            lmem_crowded = (lmem_live > lmem_limit - lmem_quota / 4);
+        }
+        if (lmem_live <= lmem_limit) {
+            lmem_over = 0;
+            return NULL;
+        }
     }
+    lmem_tripped = 1;
+    return lval_err("Evaluation went over its memory quota of %ld bytes", lmem_quota);
+}
 
-    lval_del(a);
-
-    if (f->formals->count > 0 &&
-        strcmp(f->formals->cell[0]->sym, "&") == 0) {
-            
-            if (f->formals->count != 2) {
-                return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
-            }
-    
-        lval_del(lval_pop(f->formals, 0));
-        
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
+// err, unless what an lmem_try_ allocation gave NULL for was the quota
+lval* lmem_refused(lval* err) {
+    if (!lmem_refusing) { return err; }
+    lval_del(err);
+    return lval_err("Evaluation went over its memory quota of %ld bytes", lmem_quota);
+}
 
-        lenv_put(f->env, sym, val);
-        lval_del(sym);  lval_del(val);
-    }   
-    
+// the safe point after a builtin has run: a builtin can go over the quota in one go (making a
+// Vector, joining lists), and nothing else would look before the value had been kept by a def
+// or had ended the evaluation. gives x back, or the quota error in its place
+lval* lmem_check(lval* x) {
+    if (!lmem_over || x->type == LVAL_ERR) { return x; }
+    lval* err = lmem_exceeded();
+    if (!err) { return x; }
+    lval_del(x);
+    return err;
+}
 
-    // if all formals have been bound, evaluate
-    if (f->formals->count == 0) {
-        f->env->parent = e;
+// (mem-quota n) limits every top-level evaluation, the one it is in included, to n more live
+// bytes than it started with. 0 takes the limit off
+lval* builtin_mem_quota(lenv* e, lval* a) {
+    LASSERT_NUM(a, "mem-quota", 1);
+    LASSERT_TYPE(a, "mem-quota", 0, LVAL_NUM);
+    LASSERT(a, !a->cell[0]->big && a->cell[0]->num >= 0,
+        "Function 'mem-quota' passed a quota that is out of range.");
 
-        return builtin_eval(
-            f->env, lval_add(lval_sexpr(), lval_copy(f->body))
-        );
-    } 
-    // otherwise return partially evaluated function
-    else {
-        return lval_copy(f);
-    }
+    lmem_quota = a->cell[0]->num;
+    lval_del(a);
+    lmem_set_limit();
+    return lval_sexpr();
+}
 
+long lenv_bytes(lenv* e) {
+    long n = lenv_slab.size + sizeof(int) * e->index_size;
+    if (!e->stacked) { n += (sizeof(char*) + sizeof(lval*)) * e->cap; }
+    return n;
 }
 
+// the bytes v owns: itself and its storage, but not what it holds, those are lvals of their own
+long lval_bytes(lval* v) {
+    long n = lval_slab.size;
+    switch (v->type) {
+        case LVAL_NUM: if (v->big) { n += lbig_bytes(v->big); } break;
+        case LVAL_ERR: n += strlen(v->err) + 1; break;
+        case LVAL_STR: if (v->str != v->sbuf) { n += v->slen + 1; } break;
+        case LVAL_QEXPR:
+        case LVAL_SEXPR:
+            n += sizeof(lval*) * v->cap;
+            if (v->code) { n += sizeof(lchunk); }
+            if (v->code && v->code->run) { n += sizeof(lcode) + sizeof(linst) * v->code->run->cap; }
+        break;
+        case LVAL_FUN: if (!v->builtin) { n += lenv_bytes(v->env); } break;
+        case LVAL_VEC: n += lvec_bytes(v); break;
+        case LVAL_MAP:
+            n += sizeof(lmap) + (sizeof(lval*) * 2 + sizeof(unsigned)) * v->map->cap
+                + sizeof(int) * v->map->index_size;
+        break;
+        case LVAL_BUILDER: n += v->bcap; break;
+    }
+    return n;
+}
 
-/* Evaluation */
+long lmem_types[LVAL_BUILDER + 1];
 
-lval* lval_eval_sexpr(lenv* e, lval* v) {
+void lmem_tally(void* p) {
+    lval* v = p;
+    if (v->type != LVAL_FREE) { lmem_types[v->type] += lval_bytes(v); }
+}
 
-    // evaluate children
-    for (int i=0; i < v->count; i++) {
-        v->cell[i] = lval_eval(e, v->cell[i]);
-    }   
+// (mem-stats "total") -> {live-bytes peak-bytes quota}
+// (mem-stats "types") -> {{"Error" bytes} {"Number" bytes} ... {"Other" bytes}}, the live bytes
+// of each type of lval. other is envs that aren't a function's own (the globals and frames) and
+// lvals the collector has yet to hand back
+lval* builtin_mem_stats(lenv* e, lval* a) {
+    LASSERT_NUM(a, "mem-stats", 1);
+    LASSERT_TYPE(a, "mem-stats", 0, LVAL_STR);
+    char* what = a->cell[0]->str;
 
-    // error checking
-    for (int i=0; i < v->count; i++) {
-        if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
+    if (strcmp(what, "total") == 0) {
+        lval_del(a);
+        lval* v = lval_add(lval_qexpr(), lval_num(lmem_live));
+        v = lval_add(v, lval_num(lmem_peak));
+        v = lval_add(v, lval_num(lmem_quota));
+        return v;
     }
 
-    if (v->count == 0) { return v; }
-    if (v->count == 1) { return lval_take(v,0); }
+    LASSERT(a, strcmp(what, "types") == 0,
+        "Function 'mem-stats' passed unknown action \"%s\"", what);
+    lval_del(a);
 
-    // ensure first element is func after eval
-    lval* f = lval_pop(v, 0);
-    if (f->type != LVAL_FUN) {
-        lval* err = lval_err(
-            "S-Expression starts with incorrect type. Got %s, expected %s.", 
-            ltype_name(f->type), ltype_name(LVAL_FUN)
-        );
-        lval_del(f);
-        lval_del(v);
-        return err;
+    // tally first, the result is more lvals
+    memset(lmem_types, 0, sizeof(lmem_types));
+    lslab_each(&lval_slab, lmem_tally);
+    long other = lmem_live;
+    for (int t = 0; t <= LVAL_BUILDER; t++) { other -= lmem_types[t]; }
+
+    lval* v = lval_qexpr();
+    for (int t = 0; t <= LVAL_BUILDER; t++) {
+        lval* row = lval_add(lval_qexpr(), lval_str(ltype_name(t)));
+        v = lval_add(v, lval_add(row, lval_num(lmem_types[t])));
     }
+    lval* row = lval_add(lval_qexpr(), lval_str("Other"));
+    return lval_add(v, lval_add(row, lval_num(other)));
+}
 
-    lval* result = lval_call(e, f, v);
-    lval_del(f);
-    return result;
+lval* lval_eval(lenv* e, lval* v) {
+    return lvm_enabled ? lvm_eval(e, v) : lval_eval_tree(e, v);
 }
 
+// what a memory quota applies to. loading a file from inside one doesn't start new ones
+lval* lval_eval_top(lenv* e, lval* v) {
+    if (!lmem_depth) { lmem_begin(); }
+    lmem_depth++;
+    lval* x = lmem_check(lval_eval(e, v));
+    lmem_depth--;
+    return x;
+}
 
-lval* lval_eval(lenv* e, lval* v) {
-    if (v->type == LVAL_SYM) {
-        lval* x = lenv_get(e, v);
-        lval_del(v);
-        return x;
-    }
+// evaluates the contents of list l (which is taken over) as an S-Expression, whatever type l
+// is. the VM runs l's cached code, the tree walker needs its own S-Expression to work on
+lval* lval_run(lenv* e, lval* l) {
+    if (lvm_enabled) { return lvm_run(e, l, NULL); }
 
-    if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(e, v); }
-    return v;
+    l = lval_own(l);
+    l->type = LVAL_SEXPR;
+    return lval_eval_tree(e, l);
 }
 
 
@@ -900,9 +5204,14 @@ lval* lval_eval(lenv* e, lval* v) {
 /* Reading */
 
 lval* lval_read_num(mpc_ast_t* t) {
+    if (strpbrk(t->contents, ".eE")) {
+        double d = strtod(t->contents, NULL);
+        return isfinite(d) ? lval_dbl(d) : lval_err("Float %s is out of range", t->contents);
+    }
+
     errno = 0;
     long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE ? lval_num(x) : lval_err("invalid number");
+    return errno != ERANGE ? lval_num(x) : lval_big(lbig_read(t->contents));
 }
 
 lval* lval_read_str(mpc_ast_t* t) {
@@ -954,18 +5263,18 @@ lval* lval_read(mpc_ast_t* t) {
 
 int main (int argc, char** argv) {
 
-    mpc_parser_t* Number = mpc_new("number");
-    mpc_parser_t* Symbol = mpc_new("symbol");
-    mpc_parser_t* String = mpc_new("string");
-    mpc_parser_t* Comment = mpc_new("comment");
-    mpc_parser_t* Sexpr  = mpc_new("sexpr");
-    mpc_parser_t* Qexpr  = mpc_new("qexpr");
-    mpc_parser_t* Expr   = mpc_new("expr");
-    mpc_parser_t* Lispy  = mpc_new("lispy");
+    Number = mpc_new("number");
+    Symbol = mpc_new("symbol");
+    String = mpc_new("string");
+    Comment = mpc_new("comment");
+    Sexpr  = mpc_new("sexpr");
+    Qexpr  = mpc_new("qexpr");
+    Expr   = mpc_new("expr");
+    Lispy  = mpc_new("lispy");
 
     mpca_lang(MPCA_LANG_DEFAULT,
     "                                                       \
-        number : /-?[0-9]+/ ;                               \
+        number : /-?[0-9]+(\\.[0-9]+)?([eE][-+]?[0-9]+)?/ ; \
         symbol : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;         \
         string  : /\"(\\\\.|[^\"])*\"/ ;                    \
         comment : /;[^\\r\\n]*/ ;                           \
@@ -978,45 +5287,77 @@ int main (int argc, char** argv) {
     Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
 
 
+    lsym_init();
+    lval_init();
+
     lenv* e = lenv_new();
+    lenv_globals = e;
     lenv_add_builtins(e);
+
+    // options come before any files. --vm runs everything on the bytecode VM, --no-fold leaves
+    // calls on constants to be worked out every time they run, --gc-budget=n is (gc "budget" n)
+    // and --mem-quota=n is (mem-quota n)
+    lgc_set_budget(LGC_BUDGET);
+    int first = 1;
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--vm") == 0) {
+            lvm_enabled = 1;
+        } else if (strcmp(argv[first], "--no-fold") == 0) {
+            lfold_enabled = 0;
+        } else if (strncmp(argv[first], "--gc-budget=", 12) == 0) {
+            long n = atol(argv[first] + 12);
+            lgc_set_budget(n > 0 ? n : 0);
+        } else if (strncmp(argv[first], "--mem-quota=", 12) == 0) {
+            long n = atol(argv[first] + 12);
+            lmem_quota = n > 0 ? n : 0;
+        } else {
+            printf("Unknown option %s\n", argv[first]);
+        }
+        first++;
+    }
     
-    while (1) {
+    // no files given, start the interactive prompt
+    if (first == argc) {
+        while (1) {
 
-        char* input = readline("lispy> ");
+            char* input = readline("lispy> ");
 
-        // enter 'exit' or 'quit' to break
-        if (input == NULL || strcmp(input, "exit") == 0 || strcmp(input, "quit") == 0) {
-            puts("Exiting..");
-            free(input);
-            break;
-        }
+            // enter 'exit' or 'quit' to break
+            if (input == NULL || strcmp(input, "exit") == 0 || strcmp(input, "quit") == 0) {
+                puts("Exiting..");
+                free(input);
+                break;
+            }
 
-        // readline history is stored separately, primarily in the heap. Calling free() doesn't affect this; there are separate functions to read/write the readline history
-        add_history(input);
+            // readline history is stored separately, primarily in the heap. Calling free() doesn't affect this; there are separate functions to read/write the readline history
+            add_history(input);
 
-        // pass user input
-        mpc_result_t r;
-        if (mpc_parse("<stdin>", input, Lispy, &r)) {
+            // pass user input
+            mpc_result_t r;
+            if (mpc_parse("<stdin>", input, Lispy, &r)) {
 
-            // lval result = eval(r.output);
-            lval* x = lval_eval(e, lval_read(r.output));
-            lval_println(x);
-            lval_del(x);
+                // lval result = eval(r.output);
+                lval* v = lval_read(r.output);
+                mpc_ast_delete(r.output);
+                lval* x = lval_eval_top(e, v);
+                lval_println(x);
+                lval_del(x);
+                larena_reset();
 
-        } else {
-            mpc_err_print(r.error);
-            mpc_err_delete(r.error);
-        }
-        // if successful, eval & print, else error
+            } else {
+                mpc_err_print(r.error);
+                mpc_err_delete(r.error);
+            }
+            // if successful, eval & print, else error
 
-        free(input);
+            free(input);
+        }
     }
 
     // add other files
-    if (argc >= 2) {
+    if (first < argc) {
         // loop over each supplied filename
-        for (int i = 0; i < argc; i++) {
+        for (int i = first; i < argc; i++) {
             // args list with a single arg: the filename
             lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
             // pass this to load fn
@@ -1030,6 +5371,26 @@ int main (int argc, char** argv) {
     }
 
     lenv_del(e);
+    // whatever is left now is in cycles
+    lgc_collect_now(1);
+    free(lgc_young);
+    free(lgc_set);
+    free(lgc_set_refs);
+    free(lgc_table);
+    free(lgc_grey);
+    free(lgc_cands);
+    free(lgc_deferred);
+    free(lgc_objs);
+    free(lgc_refs);
+    free(lgc_stack);
+    free(lvm_stack);
+    free(lframe_syms);
+    free(lframe_vals);
+    free(larena);
+    free(larena_owners);
+    lsym_cleanup();
+    lslab_cleanup(&lval_slab);
+    lslab_cleanup(&lenv_slab);
     mpc_cleanup(8,
     Number, Symbol, String, Comment,
     Sexpr, Qexpr, Expr, Lispy);
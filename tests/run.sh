@@ -0,0 +1,31 @@
+#!/bin/sh
+# runs every tests/*.lspy under the tree-walker, under --vm and with --no-fold, and diffs what it
+# prints against the .out file next to it. the C stack is capped at 1MB, so a loop that isn't
+# really running in constant stack crashes instead of passing
+#
+#   tests/run.sh [path/to/lispy]     (defaults to ./lispy, built with the line in the README)
+
+lispy=${1:-./lispy}
+dir=$(dirname "$0")
+fail=0
+
+if [ ! -x "$lispy" ]; then
+    echo "no lispy binary at $lispy"
+    exit 2
+fi
+
+for t in "$dir"/*.lspy; do
+    name=$(basename "$t" .lspy)
+    for mode in "" --vm --no-fold; do
+        got=$( (ulimit -s 1024; "$lispy" $mode "$t") 2>&1 )
+        if [ "$got" = "$(cat "$dir/$name.out")" ]; then
+            echo "ok   $name ${mode:-tree}"
+        else
+            echo "FAIL $name ${mode:-tree}"
+            echo "$got" | diff "$dir/$name.out" - | head -20
+            fail=1
+        fi
+    done
+done
+
+exit $fail